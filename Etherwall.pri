@@ -0,0 +1,123 @@
+# everything but main.cpp, shared by the app and the benchmarks
+
+QT += qml quick widgets network websockets
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/src $$PWD/src/ew-node/src
+DEPENDPATH += $$PWD/src $$PWD/src/ew-node/src
+
+linux {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += hidapi-libusb libusb-1.0 protobuf libudev
+}
+
+win32 {
+    INCLUDEPATH += C:\msys64\mingw64\include
+    # PKGCONFIG += hidapi libusb-1.0 protobuf libudev
+    LIBS += -lprotobuf -lusb-1.0 -lhidapi -lsetupapi -lws2_32
+}
+
+macx {
+    QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.15
+    INCLUDEPATH += /usr/local/include
+    INCLUDEPATH += /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/System/Library/Frameworks/IOKit.framework/Headers
+    INCLUDEPATH += /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/System/Library/Frameworks/CoreFoundation.framework/Headers
+    QMAKE_LFLAGS += -F/System/Library/Frameworks/CoreFoundation.framework -F/System/Library/Frameworks/IOKit.framework
+    LIBS += -framework CoreFoundation
+    LIBS += -framework IOKit
+    LIBS += /usr/local/lib/libhidapi.a /usr/local/lib/libprotobuf.a /usr/local/lib/libusb-1.0.a
+}
+
+SOURCES += \
+    $$PWD/src/accountmodel.cpp \
+    $$PWD/src/settings.cpp \
+    $$PWD/src/transactionmodel.cpp \
+    $$PWD/src/clipboard.cpp \
+    $$PWD/src/currencymodel.cpp \
+    $$PWD/src/accountproxymodel.cpp \
+    $$PWD/src/contractmodel.cpp \
+    $$PWD/src/contractinfo.cpp \
+    $$PWD/src/eventmodel.cpp \
+    $$PWD/src/filtermodel.cpp \
+    $$PWD/src/eventcache.cpp \
+    $$PWD/src/noncemanager.cpp \
+    $$PWD/src/rpcmetrics.cpp \
+    $$PWD/src/nodetraffic.cpp \
+    $$PWD/src/startupscheduler.cpp \
+    $$PWD/src/statesnapshot.cpp \
+    $$PWD/src/settingsstore.cpp \
+    $$PWD/src/changecoalescer.cpp \
+    $$PWD/src/rowcache.cpp \
+    $$PWD/src/trezor/trezor.cpp \
+    $$PWD/src/trezor/devicepool.cpp \
+    $$PWD/src/trezor/proto/messages.pb.cc \
+    $$PWD/src/trezor/proto/messages-common.pb.cc \
+    $$PWD/src/trezor/proto/messages-management.pb.cc \
+    $$PWD/src/trezor/proto/messages-ethereum.pb.cc \
+    $$PWD/src/trezor/wire.cpp \
+    $$PWD/src/trezor/emulator.cpp \
+    $$PWD/src/trezor/hdpath.cpp \
+    $$PWD/src/platform/devicemanager.cpp \
+    $$PWD/src/initializer.cpp \
+    $$PWD/src/tokenmodel.cpp \
+    $$PWD/src/ew-node/src/etherlog.cpp \
+    $$PWD/src/ew-node/src/gethlog.cpp \
+    $$PWD/src/ew-node/src/helpers.cpp \
+    $$PWD/src/ew-node/src/types.cpp \
+    $$PWD/src/ew-node/src/ethereum/tx.cpp \
+    $$PWD/src/ew-node/src/ethereum/bigint.cpp \
+    $$PWD/src/ew-node/src/nodeipc.cpp \
+    $$PWD/src/ew-node/src/nodews.cpp \
+    $$PWD/src/gethlogapp.cpp \
+    $$PWD/src/etherlogapp.cpp \
+    $$PWD/src/logring.cpp \
+    $$PWD/src/ew-node/src/networkchainmanager.cpp \
+    $$PWD/src/nodemanager.cpp
+
+HEADERS += \
+    $$PWD/src/accountmodel.h \
+    $$PWD/src/settings.h \
+    $$PWD/src/transactionmodel.h \
+    $$PWD/src/clipboard.h \
+    $$PWD/src/currencymodel.h \
+    $$PWD/src/accountproxymodel.h \
+    $$PWD/src/contractmodel.h \
+    $$PWD/src/contractinfo.h \
+    $$PWD/src/eventmodel.h \
+    $$PWD/src/filtermodel.h \
+    $$PWD/src/eventcache.h \
+    $$PWD/src/noncemanager.h \
+    $$PWD/src/rpcmetrics.h \
+    $$PWD/src/nodetraffic.h \
+    $$PWD/src/startupscheduler.h \
+    $$PWD/src/statesnapshot.h \
+    $$PWD/src/settingsstore.h \
+    $$PWD/src/changecoalescer.h \
+    $$PWD/src/rowcache.h \
+    $$PWD/src/trezor/trezor.h \
+    $$PWD/src/trezor/devicepool.h \
+    $$PWD/src/trezor/proto/messages.pb.h \
+    $$PWD/src/trezor/proto/messages-common.pb.h \
+    $$PWD/src/trezor/proto/messages-management.pb.h \
+    $$PWD/src/trezor/proto/messages-ethereum.pb.h \
+    $$PWD/src/trezor/wire.h \
+    $$PWD/src/trezor/emulator.h \
+    $$PWD/src/trezor/hdpath.h \
+    $$PWD/src/platform/devicemanager.h \
+    $$PWD/src/initializer.h \
+    $$PWD/src/tokenmodel.h \
+    $$PWD/src/cert.h \
+    $$PWD/src/ew-node/src/types.h \
+    $$PWD/src/ew-node/src/etherlog.h \
+    $$PWD/src/ew-node/src/gethlog.h \
+    $$PWD/src/ew-node/src/helpers.h \
+    $$PWD/src/ew-node/src/nodeipc.h \
+    $$PWD/src/ew-node/src/nodews.h \
+    $$PWD/src/ew-node/src/ethereum/bigint.h \
+    $$PWD/src/ew-node/src/ethereum/tx.h \
+    $$PWD/src/ew-node/src/ethereum/keccak.h \
+    $$PWD/src/gethlogapp.h \
+    $$PWD/src/etherlogapp.h \
+    $$PWD/src/logring.h \
+    $$PWD/src/ew-node/src/networkchainmanager.h \
+    $$PWD/src/nodemanager.h
@@ -0,0 +1,16 @@
+# shared by the benchmark subprojects, builds the app sources without main.cpp
+
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include($$PWD/../Etherwall.pri)
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/benchreport.cpp
+
+HEADERS += \
+    $$PWD/benchreport.h
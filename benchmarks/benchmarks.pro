@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+
+# QtTest benchmarks, run with "make check" or each binary on its own. Results are also
+# written as JSON to bench_<name>.json in $ETHERWALL_BENCH_DIR or the working dir
+SUBDIRS = models trezor
@@ -0,0 +1,84 @@
+#include "benchreport.h"
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QDir>
+#include <QDebug>
+
+namespace Etherwall {
+
+    BenchReport::Run::Run(BenchReport& report, const QString& name) :
+        fReport(report), fName(name), fTimer(), fTotal(0), fRuns(0), fExtra()
+    {
+    }
+
+    BenchReport::Run::~Run()
+    {
+        fReport.add(fName, fTotal, fRuns, fExtra);
+    }
+
+    void BenchReport::Run::start()
+    {
+        fTimer.start();
+    }
+
+    void BenchReport::Run::stop()
+    {
+        fTotal += fTimer.nsecsElapsed();
+        fRuns++;
+    }
+
+    void BenchReport::Run::set(const QString& key, const QJsonValue& value)
+    {
+        fExtra[key] = value;
+    }
+
+    BenchReport::BenchReport(const QString& name) :
+        fName(name), fResults(), fSections()
+    {
+    }
+
+    void BenchReport::add(const QString& name, qint64 totalNs, int runs, const QJsonObject& extra)
+    {
+        if ( runs == 0 ) {
+            return; // skipped or failed before the first run
+        }
+
+        QJsonObject result = extra;
+        result["name"] = name;
+        result["runs"] = runs;
+        result["totalNs"] = totalNs;
+        result["meanNs"] = totalNs / runs;
+        fResults.append(result);
+    }
+
+    void BenchReport::setSection(const QString& key, const QJsonValue& value)
+    {
+        fSections[key] = value;
+    }
+
+    bool BenchReport::write() const
+    {
+        QJsonObject root = fSections;
+        root["benchmark"] = fName;
+        root["qt"] = QString(qVersion());
+        root["results"] = fResults;
+
+        const QString dir = QString::fromLocal8Bit(qgetenv("ETHERWALL_BENCH_DIR"));
+        const QString fileName = QDir(dir.isEmpty() ? QDir::currentPath() : dir).filePath("bench_" + fName + ".json");
+        QSaveFile file(fileName);
+        if ( !file.open(QIODevice::WriteOnly) ) {
+            qWarning() << "Unable to write benchmark results to" << fileName << file.errorString();
+            return false;
+        }
+
+        file.write(QJsonDocument(root).toJson());
+        if ( !file.commit() ) {
+            qWarning() << "Unable to write benchmark results to" << fileName << file.errorString();
+            return false;
+        }
+
+        qDebug() << "Benchmark results written to" << fileName;
+        return true;
+    }
+
+}
@@ -0,0 +1,49 @@
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+
+namespace Etherwall {
+
+    // wall clock totals of the QBENCHMARK bodies, written as JSON since QtTest's own loggers
+    // can't do that. Goes to bench_<name>.json in $ETHERWALL_BENCH_DIR or the working directory.
+    class BenchReport
+    {
+    public:
+        // times one benchmark, start/stop around the part of the QBENCHMARK body that counts
+        class Run
+        {
+        public:
+            Run(BenchReport& report, const QString& name);
+            ~Run();
+
+            void start();
+            void stop();
+            void set(const QString& key, const QJsonValue& value);
+        private:
+            BenchReport& fReport;
+            QString fName;
+            QElapsedTimer fTimer;
+            qint64 fTotal; // nanoseconds
+            int fRuns;
+            QJsonObject fExtra;
+        };
+
+        explicit BenchReport(const QString& name);
+
+        void add(const QString& name, qint64 totalNs, int runs, const QJsonObject& extra = QJsonObject());
+        void setSection(const QString& key, const QJsonValue& value);
+        bool write() const;
+    private:
+        QString fName;
+        QJsonArray fResults;
+        QJsonObject fSections;
+    };
+
+}
+
+#endif // BENCHREPORT_H
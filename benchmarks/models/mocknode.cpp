@@ -0,0 +1,146 @@
+#include "mocknode.h"
+#include <QJsonDocument>
+#include <QHostAddress>
+#include <QDebug>
+
+namespace Etherwall {
+
+    MockNode::MockNode() : QObject(nullptr),
+        fServer("Etherwall mock node", QWebSocketServer::NonSecureMode), fClient(nullptr), fHandlers(), fCounts(), fTotal(0)
+    {
+        connect(&fServer, &QWebSocketServer::newConnection, this, &MockNode::onNewConnection);
+
+        // enough for NodeWS to get through its startup
+        handle("web3_clientVersion", [](const QJsonArray&) { return QJsonValue("Geth/v1.9.25-stable/linux-amd64/go1.15.6"); });
+        handle("net_version", [](const QJsonArray&) { return QJsonValue("1"); });
+        handle("net_peerCount", [](const QJsonArray&) { return QJsonValue("0x19"); });
+        handle("eth_syncing", [](const QJsonArray&) { return QJsonValue(false); });
+        handle("eth_gasPrice", [](const QJsonArray&) { return QJsonValue("0x3b9aca00"); });
+        handle("eth_accounts", [](const QJsonArray&) { return QJsonValue(QJsonArray()); });
+        handle("personal_listAccounts", [](const QJsonArray&) { return QJsonValue(QJsonArray()); });
+        handle("eth_newBlockFilter", [](const QJsonArray&) { return QJsonValue("0x1"); });
+        handle("eth_newFilter", [](const QJsonArray&) { return QJsonValue("0x2"); });
+        handle("eth_uninstallFilter", [](const QJsonArray&) { return QJsonValue(true); });
+        handle("eth_getFilterChanges", [](const QJsonArray&) { return QJsonValue(QJsonArray()); });
+        handle("eth_getLogs", [](const QJsonArray&) { return QJsonValue(QJsonArray()); });
+    }
+
+    MockNode::~MockNode()
+    {
+        fServer.close();
+    }
+
+    bool MockNode::listen()
+    {
+        return fServer.listen(QHostAddress::LocalHost, 0);
+    }
+
+    const QString MockNode::endpoint() const
+    {
+        return "ws://127.0.0.1:" + QString::number(fServer.serverPort());
+    }
+
+    void MockNode::handle(const QString& method, const Handler& handler)
+    {
+        fHandlers[method] = handler;
+    }
+
+    int MockNode::requestCount(const QString& method) const
+    {
+        return fCounts.value(method, 0);
+    }
+
+    int MockNode::requestTotal() const
+    {
+        return fTotal;
+    }
+
+    const QJsonObject MockNode::requestCounts() const
+    {
+        QJsonObject result;
+        QMapIterator<QString, int> i(fCounts);
+        while ( i.hasNext() ) {
+            i.next();
+            result[i.key()] = i.value();
+        }
+
+        return result;
+    }
+
+    void MockNode::resetCounts()
+    {
+        fCounts.clear();
+    }
+
+    void MockNode::onNewConnection()
+    {
+        QWebSocket* client = fServer.nextPendingConnection();
+        if ( client == nullptr ) {
+            return;
+        }
+
+        // NodeWS keeps a single connection, a new one replaces the old
+        if ( fClient != nullptr ) {
+            fClient->disconnect(this);
+            fClient->close();
+            fClient->deleteLater();
+        }
+
+        fClient = client;
+        connect(fClient, &QWebSocket::textMessageReceived, this, &MockNode::onMessage);
+        connect(fClient, &QWebSocket::disconnected, this, &MockNode::onDisconnected);
+    }
+
+    void MockNode::onMessage(const QString& message)
+    {
+        QWebSocket* client = qobject_cast<QWebSocket*>(sender());
+        if ( client == nullptr ) {
+            return;
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8(), &parseError);
+        if ( parseError.error != QJsonParseError::NoError ) {
+            qWarning() << "Mock node ignoring unparsable request:" << message;
+            return;
+        }
+
+        if ( doc.isArray() ) {
+            QJsonArray replies;
+            foreach ( const QJsonValue& request, doc.array() ) {
+                replies.append(answer(request.toObject()));
+            }
+            client->sendTextMessage(QString::fromUtf8(QJsonDocument(replies).toJson(QJsonDocument::Compact)));
+            return;
+        }
+
+        const QJsonObject reply = answer(doc.object());
+        client->sendTextMessage(QString::fromUtf8(QJsonDocument(reply).toJson(QJsonDocument::Compact)));
+    }
+
+    void MockNode::onDisconnected()
+    {
+        QWebSocket* client = qobject_cast<QWebSocket*>(sender());
+        if ( client == nullptr || client != fClient ) {
+            return;
+        }
+
+        fClient->deleteLater();
+        fClient = nullptr;
+    }
+
+    const QJsonObject MockNode::answer(const QJsonObject& request)
+    {
+        const QString method = request.value("method").toString();
+        fCounts[method]++;
+        fTotal++;
+
+        QJsonObject reply;
+        reply["jsonrpc"] = QString("2.0");
+        reply["id"] = request.value("id");
+        reply["result"] = fHandlers.contains(method) ? fHandlers.value(method)(request.value("params").toArray()) : QJsonValue();
+
+        return reply;
+    }
+
+}
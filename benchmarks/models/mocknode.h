@@ -0,0 +1,50 @@
+#ifndef MOCKNODE_H
+#define MOCKNODE_H
+
+#include <QObject>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QJsonValue>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QHash>
+#include <QMap>
+#include <functional>
+
+namespace Etherwall {
+
+    // local JSON-RPC websocket node for the benchmarks, NodeWS connects to endpoint().
+    // Replies come from per method handlers, methods without one get a null result.
+    class MockNode : public QObject
+    {
+        Q_OBJECT
+    public:
+        typedef std::function<QJsonValue (const QJsonArray& params)> Handler;
+
+        MockNode();
+        virtual ~MockNode();
+
+        bool listen();
+        const QString endpoint() const;
+        void handle(const QString& method, const Handler& handler);
+        int requestCount(const QString& method) const;
+        int requestTotal() const;
+        const QJsonObject requestCounts() const;
+        void resetCounts();
+    private slots:
+        void onNewConnection();
+        void onMessage(const QString& message);
+        void onDisconnected();
+    private:
+        QWebSocketServer fServer;
+        QWebSocket* fClient;
+        QHash<QString, Handler> fHandlers;
+        QMap<QString, int> fCounts;
+        int fTotal; // all answered, not reset
+
+        const QJsonObject answer(const QJsonObject& request);
+    };
+
+}
+
+#endif // MOCKNODE_H
@@ -0,0 +1,10 @@
+TARGET = tst_models
+
+include(../benchmarks.pri)
+
+SOURCES += \
+    tst_models.cpp \
+    mocknode.cpp
+
+HEADERS += \
+    mocknode.h
@@ -0,0 +1,387 @@
+#include <QtTest>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QScopedPointer>
+#include <QSettings>
+#include <QAtomicInt>
+#include <QSslConfiguration>
+#include <QJsonDocument>
+#include <algorithm>
+#include <random>
+#include "etherlogapp.h"
+#include "gethlogapp.h"
+#include "settingsstore.h"
+#include "nodews.h"
+#include "rpcmetrics.h"
+#include "currencymodel.h"
+#include "noncemanager.h"
+#include "accountmodel.h"
+#include "transactionmodel.h"
+#include "contractmodel.h"
+#include "eventcache.h"
+#include "filtermodel.h"
+#include "eventmodel.h"
+#include "helpers.h"
+#include "trezor/devicepool.h"
+#include "mocknode.h"
+#include "benchreport.h"
+
+using namespace Etherwall;
+
+namespace {
+
+    const int ACCOUNTS = 500;
+    const int BLOCKS = 1000;
+    const int BLOCK_TRANSACTIONS = 10;
+    const int LOGS = 10000;
+    const int EVENT_BATCH = 100;
+    const int HISTORY = 2000;
+    const int HISTORY_RECENT = 100; // within a day of the head, refetched from the node on restore
+    const quint64 HEAD = 12000000;
+    const qint64 TIMEOUT = 120000;
+    const QString TOKEN = "0x00000000000000000000000000000000000000aa";
+    const QString TRANSFER_TOPIC = "0xddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef";
+    const QString TRANSFER_ABI = "[{\"anonymous\":false,\"inputs\":["
+                                 "{\"indexed\":true,\"name\":\"from\",\"type\":\"address\"},"
+                                 "{\"indexed\":true,\"name\":\"to\",\"type\":\"address\"},"
+                                 "{\"indexed\":false,\"name\":\"value\",\"type\":\"uint256\"}],"
+                                 "\"name\":\"Transfer\",\"type\":\"event\"}]";
+
+    const QString address(int n) {
+        return "0x" + QString::number(n + 1, 16).rightJustified(40, '0');
+    }
+
+    const QString hash(const QString& kind, quint64 n) {
+        return "0x" + (kind + QString::number(n, 16)).rightJustified(64, '0');
+    }
+
+    const QString word(const QString& hex) {
+        return hex.mid(2).rightJustified(64, '0');
+    }
+
+    const QJsonObject transaction(quint64 block, int index, const QString& from, const QString& to) {
+        QJsonObject tx;
+        tx["hash"] = hash("a", block * 1000 + index);
+        tx["nonce"] = Helpers::toHexStr(index);
+        tx["blockHash"] = hash("b", block);
+        tx["blockNumber"] = Helpers::toHexStr(block);
+        tx["transactionIndex"] = Helpers::toHexStr(index);
+        tx["from"] = from;
+        tx["to"] = to;
+        tx["value"] = QString("0xde0b6b3a7640000");
+        tx["gas"] = QString("0x5208");
+        tx["gasPrice"] = QString("0x3b9aca00");
+        tx["input"] = QString("0x");
+
+        return tx;
+    }
+
+    const QJsonObject transferLog(quint64 block, int index) {
+        QJsonArray topics;
+        topics.append(TRANSFER_TOPIC);
+        topics.append("0x" + word(address(index % ACCOUNTS)));
+        topics.append("0x" + word(address(ACCOUNTS + index)));
+
+        QJsonObject log;
+        log["address"] = TOKEN;
+        log["topics"] = topics;
+        log["data"] = "0x" + QString::number(index + 1, 16).rightJustified(64, '0');
+        log["blockNumber"] = Helpers::toHexStr(block);
+        log["blockHash"] = hash("b", block);
+        log["transactionHash"] = hash("c", index);
+        log["transactionIndex"] = QString("0x0");
+        log["logIndex"] = Helpers::toHexStr(index);
+        log["removed"] = false;
+
+        return log;
+    }
+
+}
+
+// drives the models through NodeWS against a local mock node, timings go to bench_models.json
+class TestModels : public QObject
+{
+    Q_OBJECT
+public:
+    TestModels();
+private slots:
+    void initTestCase();
+    void accounts500();
+    void historyRestore();
+    void blocks1000();
+    void logs10k();
+    void insertEvents();
+    void abiDecoding();
+    void cleanupTestCase();
+private:
+    MockNode fNode;
+    BenchReport fReport;
+    QAtomicInt fHandled; // requestDone count, emitted on the IPC handler thread
+    QStringList fAccounts;
+    QList<QJsonObject> fBlocks;
+    QJsonArray fLogs;
+    QMap<QString, QJsonObject> fHistory; // by hash
+
+    // same order as main.cpp, destroyed in reverse
+    QScopedPointer<EtherLogApp> fLog;
+    QScopedPointer<SettingsStore> fSettingsStore;
+    QScopedPointer<GethLogApp> fGethLog;
+    QScopedPointer<Trezor::DevicePool> fTrezor;
+    QScopedPointer<NodeWS> fIpc;
+    QScopedPointer<RpcMetrics> fMetrics;
+    QScopedPointer<CurrencyModel> fCurrencyModel;
+    QScopedPointer<NonceManager> fNonceManager;
+    QScopedPointer<AccountModel> fAccountModel;
+    QScopedPointer<TransactionModel> fTransactionModel;
+    QScopedPointer<ContractModel> fContractModel;
+    QScopedPointer<EventCache> fEventCache;
+    QScopedPointer<FilterModel> fFilterModel;
+    QScopedPointer<EventModel> fEventModel;
+
+    bool settle();
+};
+
+TestModels::TestModels() : QObject(nullptr),
+    fNode(), fReport("models"), fHandled(0), fAccounts(), fBlocks(), fLogs(), fHistory()
+{
+}
+
+void TestModels::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication::setOrganizationName("Etherdyne");
+    QCoreApplication::setApplicationName("EtherwallBench");
+    QSettings().clear();
+
+    for ( int i = 0; i < ACCOUNTS; i++ ) {
+        fAccounts.append(address(i));
+    }
+
+    // blocks right below the head, each with transactions from our accounts
+    for ( int b = 0; b < BLOCKS; b++ ) {
+        const quint64 number = HEAD - BLOCKS + b;
+        QJsonArray transactions;
+        for ( int t = 0; t < BLOCK_TRANSACTIONS; t++ ) {
+            transactions.append(transaction(number, t, address((b * BLOCK_TRANSACTIONS + t) % ACCOUNTS), address(ACCOUNTS + t)));
+        }
+
+        QJsonObject block;
+        block["number"] = Helpers::toHexStr(number);
+        block["hash"] = hash("b", number);
+        block["miner"] = address(ACCOUNTS + BLOCK_TRANSACTIONS);
+        block["transactions"] = transactions;
+        fBlocks.append(block);
+    }
+
+    // within the default day of log window
+    for ( int i = 0; i < LOGS; i++ ) {
+        fLogs.append(transferLog(HEAD - 7000 + (quint64)i * 7000 / LOGS, i));
+    }
+
+    // mostly old history, only the recent tail is asked for again
+    for ( int i = 0; i < HISTORY; i++ ) {
+        const quint64 number = i < HISTORY - HISTORY_RECENT ? HEAD - 1000000 + i * 100 : HEAD - 2000 - HISTORY + i;
+        const QJsonObject tx = transaction(number, 0, address(i % ACCOUNTS), address(ACCOUNTS));
+        fHistory.insert(tx.value("hash").toString(), tx);
+    }
+
+    fNode.handle("eth_blockNumber", [](const QJsonArray&) { return QJsonValue(Helpers::toHexStr(HEAD)); });
+    fNode.handle("eth_accounts", [this](const QJsonArray&) { return QJsonValue(QJsonArray::fromStringList(fAccounts)); });
+    fNode.handle("personal_listAccounts", [this](const QJsonArray&) { return QJsonValue(QJsonArray::fromStringList(fAccounts)); });
+    fNode.handle("eth_getBalance", [](const QJsonArray&) { return QJsonValue("0xde0b6b3a7640000"); });
+    fNode.handle("eth_getTransactionCount", [](const QJsonArray&) { return QJsonValue("0x5"); });
+    fNode.handle("eth_getLogs", [this](const QJsonArray&) { return QJsonValue(fLogs); });
+    fNode.handle("eth_getTransactionByHash", [this](const QJsonArray& params) {
+        return QJsonValue(fHistory.value(params.at(0).toString()));
+    });
+    QVERIFY(fNode.listen());
+
+    fLog.reset(new EtherLogApp());
+    fSettingsStore.reset(new SettingsStore());
+    fGethLog.reset(new GethLogApp());
+    fTrezor.reset(new Trezor::DevicePool());
+    fIpc.reset(new NodeWS(*fGethLog));
+    fMetrics.reset(new RpcMetrics(*fIpc));
+    fCurrencyModel.reset(new CurrencyModel(QSslConfiguration::defaultConfiguration()));
+    fNonceManager.reset(new NonceManager(*fIpc));
+    fAccountModel.reset(new AccountModel(*fIpc, *fCurrencyModel, *fTrezor, *fNonceManager));
+    fTransactionModel.reset(new TransactionModel(*fIpc, *fAccountModel, QSslConfiguration::defaultConfiguration()));
+    fContractModel.reset(new ContractModel(*fIpc, *fAccountModel));
+    fEventCache.reset(new EventCache());
+    fFilterModel.reset(new FilterModel(*fIpc, *fEventCache));
+    fEventModel.reset(new EventModel(*fContractModel, *fFilterModel, *fEventCache));
+
+    connect(fContractModel.data(), &ContractModel::logsFetched, fFilterModel.data(), &FilterModel::onLogsFetched);
+    connect(fContractModel.data(), &ContractModel::logsLost, fFilterModel.data(), &FilterModel::onLogsLost);
+    connect(fIpc.data(), &NodeIPC::requestDone, this, [this]() { fHandled.ref(); }, Qt::DirectConnection);
+
+    QSignalSpy connected(fIpc.data(), &NodeIPC::connectToServerDone);
+    fIpc->start(QString(), QString(), fNode.endpoint(), QString());
+    QVERIFY(connected.wait(TIMEOUT));
+    QVERIFY(settle());
+}
+
+// NodeWS runs one request at a time, we're done once all the mock answered got handled
+// and it stays that way for a moment so follow ups queued by the models had a chance to go out
+bool TestModels::settle()
+{
+    QElapsedTimer timer;
+    QElapsedTimer quiet;
+    timer.start();
+    while ( timer.elapsed() < TIMEOUT ) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        if ( fHandled.load() < fNode.requestTotal() || fIpc->getBusy() ) {
+            quiet.invalidate();
+        } else if ( !quiet.isValid() ) {
+            quiet.start();
+        } else if ( quiet.elapsed() >= 2 ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TestModels::accounts500()
+{
+    BenchReport::Run run(fReport, "accounts500");
+    QBENCHMARK {
+        run.start();
+        fIpc->getAccounts();
+        QVERIFY(settle());
+        run.stop();
+    }
+
+    QCOMPARE(fAccountModel->rowCount(), ACCOUNTS);
+    run.set("accounts", ACCOUNTS);
+}
+
+void TestModels::historyRestore()
+{
+    QMapIterator<QString, QJsonObject> i(fHistory);
+    while ( i.hasNext() ) {
+        i.next();
+        const QJsonObject& tx = i.value();
+        const QString key = Helpers::toDecStr(Helpers::toQUInt64(tx.value("blockNumber"))) + "_0";
+        SettingsStore::setValue("transactions/" + key, QString::fromUtf8(QJsonDocument(tx).toJson(QJsonDocument::Compact)));
+    }
+
+    BenchReport::Run run(fReport, "historyRestore");
+    QBENCHMARK {
+        run.start();
+        fTransactionModel->refresh();
+        QVERIFY(settle());
+        run.stop();
+    }
+
+    QCOMPARE(fTransactionModel->rowCount(), HISTORY);
+    run.set("transactions", HISTORY);
+    run.set("refetched", HISTORY_RECENT);
+}
+
+void TestModels::blocks1000()
+{
+    BenchReport::Run run(fReport, "blocks1000");
+    QBENCHMARK {
+        run.start();
+        foreach ( const QJsonObject& block, fBlocks ) {
+            emit fIpc->newBlock(block);
+        }
+        QVERIFY(settle());
+        run.stop();
+    }
+
+    QVERIFY(fTransactionModel->rowCount() >= BLOCKS * BLOCK_TRANSACTIONS);
+    run.set("blocks", BLOCKS);
+    run.set("transactions", BLOCKS * BLOCK_TRANSACTIONS);
+}
+
+void TestModels::logs10k()
+{
+    QVERIFY(fContractModel->addContract("Token", TOKEN, TRANSFER_ABI));
+
+    QSignalSpy fetched(fContractModel.data(), &ContractModel::logsFetched);
+    QJsonArray topics;
+    topics.append(TRANSFER_TOPIC);
+    fFilterModel->addFilter("Transfers", TOKEN, "Token", QString::fromUtf8(QJsonDocument(topics).toJson(QJsonDocument::Compact)), true);
+    QVERIFY(fetched.wait(TIMEOUT));
+    QVERIFY(settle());
+
+    BenchReport::Run run(fReport, "logs10k");
+    QBENCHMARK {
+        fetched.clear();
+        run.start();
+        fFilterModel->loadLogs();
+        QVERIFY(fetched.count() > 0 || fetched.wait(TIMEOUT));
+        QVERIFY(settle());
+        run.stop();
+    }
+
+    QVERIFY(fEventModel->rowCount(QModelIndex()) > 0);
+    run.set("logs", LOGS);
+}
+
+// the same 10k events merged in batches with blocks out of order, as log pages and
+// filter changes arrive. The "EventModel::insertEvents" handler in the JSON is the merge alone
+void TestModels::insertEvents()
+{
+    EventList events;
+    foreach ( const QJsonValue& log, fLogs ) {
+        events.append(EventInfo(log.toObject()));
+    }
+    std::shuffle(events.begin(), events.end(), std::mt19937(42));
+
+    QList<EventList> batches;
+    for ( int i = 0; i < events.size(); i += EVENT_BATCH ) {
+        batches.append(events.mid(i, EVENT_BATCH));
+    }
+
+    BenchReport::Run run(fReport, "insertEvents");
+    QBENCHMARK {
+        fEventModel->onBeforeLoadLogs();
+        run.start();
+        foreach ( const EventList& batch, batches ) {
+            fEventModel->onNewEvents(batch);
+        }
+        run.stop();
+    }
+
+    QVERIFY(fEventModel->rowCount(QModelIndex()) > 0);
+    run.set("events", LOGS);
+    run.set("batch", EVENT_BATCH);
+}
+
+void TestModels::abiDecoding()
+{
+    const ContractInfo contract("Token", TOKEN, QJsonDocument::fromJson(TRANSFER_ABI.toUtf8()).array());
+    EventList events;
+    foreach ( const QJsonValue& log, fLogs ) {
+        events.append(EventInfo(log.toObject()));
+    }
+
+    BenchReport::Run run(fReport, "abiDecoding");
+    int decoded = 0;
+    QBENCHMARK {
+        decoded = 0;
+        run.start();
+        foreach ( EventInfo info, events ) {
+            contract.processEvent(info);
+            decoded += info.getParams().size();
+        }
+        run.stop();
+    }
+
+    QCOMPARE(decoded, LOGS * 3);
+    run.set("events", LOGS);
+}
+
+void TestModels::cleanupTestCase()
+{
+    fReport.setSection("rpc", fMetrics->toJson());
+    fReport.setSection("requests", fNode.requestCounts());
+    QVERIFY(fReport.write());
+}
+
+QTEST_MAIN(TestModels)
+
+#include "tst_models.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_trezor
+
+include(../benchmarks.pri)
+
+SOURCES += \
+    tst_trezor.cpp
@@ -0,0 +1,185 @@
+#include <QtTest>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QScopedPointer>
+#include "etherlogapp.h"
+#include "trezor/trezor.h"
+#include "benchreport.h"
+
+using namespace Etherwall;
+
+namespace {
+
+    const int SIGNATURES = 50;
+    const int ADDRESSES = 100;
+    const int TX_DATA_SIZE = 64 * 1024; // streamed in TxAck chunks past the initial 1024 bytes
+    const int TIMEOUT = 30000;
+    const quint32 CHAIN_ID = 1;
+    const QString FROM = "0x0000000000000000000000000000000000000001";
+    const QString TO = "0x0000000000000000000000000000000000000002";
+    const QString PATH = "m/44'/60'/0'/0/0";
+
+    bool waitFor(QSignalSpy& spy, int count) {
+        while ( spy.count() < count ) {
+            if ( !spy.wait(TIMEOUT) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // for signals QSignalSpy can't take, it needs their arguments registered as meta types
+    bool waitFor(const int& counter, int count) {
+        QElapsedTimer timer;
+        QTimer tick; // wakes the loop up to check the deadline
+        timer.start();
+        tick.start(100);
+        while ( counter < count ) {
+            if ( timer.elapsed() > TIMEOUT ) {
+                return false;
+            }
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+
+        return true;
+    }
+
+}
+
+// drives TrezorDevice against the in-process emulator, no hardware or GUI needed.
+// Timings go to bench_trezor.json
+class TestTrezor : public QObject
+{
+    Q_OBJECT
+public:
+    TestTrezor();
+private slots:
+    void initTestCase();
+    void signingThroughput();
+    void queueingLatency();
+    void txAckStreaming();
+    void cleanupTestCase();
+private:
+    BenchReport fReport;
+    QScopedPointer<EtherLogApp> fLog;
+    QScopedPointer<Trezor::TrezorDevice> fDevice;
+};
+
+TestTrezor::TestTrezor() : QObject(nullptr),
+    fReport("trezor")
+{
+}
+
+void TestTrezor::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication::setOrganizationName("Etherdyne");
+    QCoreApplication::setApplicationName("EtherwallBench");
+
+    // an emulator script without PIN or button prompts, it answers right away
+    qputenv("ETHERWALL_TREZOR_EMULATOR", "none");
+
+    fLog.reset(new EtherLogApp());
+    fDevice.reset(new Trezor::TrezorDevice());
+
+    QSignalSpy initialized(fDevice.data(), &Trezor::TrezorDevice::initialized);
+    fDevice->onDeviceInserted(QString());
+    QVERIFY(waitFor(initialized, 1));
+    QVERIFY(fDevice->isInitialized());
+}
+
+void TestTrezor::signingThroughput()
+{
+    int ready = 0;
+    connect(fDevice.data(), &Trezor::TrezorDevice::transactionReady, this, [&ready]() { ready++; });
+    QSignalSpy failure(fDevice.data(), &Trezor::TrezorDevice::failure);
+
+    BenchReport::Run run(fReport, "signingThroughput");
+    QBENCHMARK {
+        ready = 0;
+        run.start();
+        for ( int i = 0; i < SIGNATURES; i++ ) {
+            fDevice->signTransaction(CHAIN_ID, PATH, FROM, TO, "0.1", i + 1, "21000", "20");
+            QVERIFY(waitFor(ready, i + 1));
+        }
+        run.stop();
+    }
+
+    fDevice->disconnect(this);
+    QCOMPARE(failure.count(), 0);
+    run.set("signatures", SIGNATURES);
+}
+
+void TestTrezor::queueingLatency()
+{
+    QList<Trezor::HDPath> paths;
+    for ( int i = 0; i < ADDRESSES; i++ ) {
+        paths.append(Trezor::HDPath("m/44'/60'/0'/0/" + QString::number(i)));
+    }
+
+    QSignalSpy retrieved(fDevice.data(), &Trezor::TrezorDevice::addressRetrieved);
+    QElapsedTimer timer;
+    qint64 first = 0;
+    qint64 firstTotal = 0;
+    int runs = 0;
+    connect(fDevice.data(), &Trezor::TrezorDevice::addressRetrieved, this, [&]() {
+        if ( first == 0 ) {
+            first = timer.nsecsElapsed();
+        }
+    });
+
+    // the whole batch goes to the worker at once, first is how long the head waits on the queue
+    BenchReport::Run run(fReport, "queueingLatency");
+    QBENCHMARK {
+        retrieved.clear();
+        first = 0;
+        timer.start();
+        run.start();
+        fDevice->getAddresses(paths);
+        QVERIFY(waitFor(retrieved, ADDRESSES));
+        run.stop();
+        firstTotal += first;
+        runs++;
+    }
+
+    fDevice->disconnect(this);
+    run.set("addresses", ADDRESSES);
+    run.set("firstNs", runs > 0 ? firstTotal / runs : 0);
+}
+
+void TestTrezor::txAckStreaming()
+{
+    QString data = "0x";
+    data.reserve(2 + TX_DATA_SIZE * 2);
+    for ( int i = 0; i < TX_DATA_SIZE; i++ ) {
+        data += QString::number(i % 256, 16).rightJustified(2, '0');
+    }
+
+    int ready = 0;
+    connect(fDevice.data(), &Trezor::TrezorDevice::transactionReady, this, [&ready]() { ready++; });
+    QSignalSpy failure(fDevice.data(), &Trezor::TrezorDevice::failure);
+
+    BenchReport::Run run(fReport, "txAckStreaming");
+    QBENCHMARK {
+        ready = 0;
+        run.start();
+        fDevice->signTransaction(CHAIN_ID, PATH, FROM, TO, "0", 1, "3000000", "20", data);
+        QVERIFY(waitFor(ready, 1));
+        run.stop();
+    }
+
+    fDevice->disconnect(this);
+    QCOMPARE(failure.count(), 0);
+    run.set("dataBytes", TX_DATA_SIZE);
+}
+
+void TestTrezor::cleanupTestCase()
+{
+    fDevice.reset();
+    QVERIFY(fReport.write());
+}
+
+QTEST_GUILESS_MAIN(TestTrezor)
+
+#include "tst_trezor.moc"
@@ -33,8 +33,10 @@ Dialog {
     height: 7 * dpi
     focus: true
     anchors.centerIn: parent
+    property int eventIndex : -1
 
     function display( index ) {
+        eventIndex = index
         if ( index >= 0 ) {
             nameField.text = eventModel.getName(index);
             contractField.text = eventModel.getContract(index);
@@ -100,7 +102,7 @@ Dialog {
                     text: qsTr("Copy Value")
                     onTriggered: {
                         if ( argsField.currentRow >= 0 ) {
-                            clipboard.setText(eventModel.getParamValue(argsField.currentRow))
+                            clipboard.setText(eventModel.getParamValue(eventIndex, argsField.currentRow))
                         }
                     }
                 }
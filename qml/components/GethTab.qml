@@ -51,7 +51,7 @@ Loader {
 
                 ListView {
                     anchors.fill: parent
-                    model: geth
+                    model: gethRing
 
                     delegate: Text {
                         anchors.left: parent.left
@@ -75,7 +75,7 @@ Loader {
 
                 ListView {
                     anchors.fill: parent
-                    model: log
+                    model: logRing
 
                     delegate: Text {
                         anchors.left: parent.left
@@ -524,7 +524,7 @@ Item {
 
                 // trezor asks for confirmation[s] on it's display, one more is cumbersome
                 if ( result.hdpath.length ) {
-                    trezor.signTransaction(result.chain_id, result.hdpath, result.from, result.to, result.txtVal, result.nonce, result.txtGas, result.txtGasPrice, contractData)
+                    accountModel.signTransaction(result.chain_id, result.hdpath, result.from, result.to, result.txtVal, result.nonce, result.txtGas, result.txtGasPrice, contractData)
                     return
                 }
 
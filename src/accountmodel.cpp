@@ -20,6 +20,8 @@
 
 #include "accountmodel.h"
 #include "helpers.h"
+#include "rpcmetrics.h"
+#include "settingsstore.h"
 #include "trezor/hdpath.h"
 #include <QDebug>
 #include <QSettings>
@@ -32,12 +34,17 @@
 
 namespace Etherwall {
 
-    AccountModel::AccountModel(NodeIPC& ipc, const CurrencyModel& currencyModel, Trezor::TrezorDevice& trezor) :
+    AccountModel::AccountModel(NodeIPC& ipc, const CurrencyModel& currencyModel, Trezor::DevicePool& trezor, NonceManager& nonceManager) :
         QAbstractTableModel(0),
-        fIpc(ipc), fAccountList(), fAliasMap(), fTrezor(trezor),
+        fIpc(ipc), fAccountList(), fAliasMap(), fTrezor(trezor), fNonces(nonceManager),
         fSelectedAccountRow(-1), fCurrencyModel(currencyModel), fBusy(false),
-        fCurrentToken("ETH")
+        fCurrentToken("ETH"), fCurrentTokenAddress(), fTrezorImports(), fTrezorImportsPending(), fTrezorImportTimer(), fSigningTags(), fChanges(*this), fDisplay(*this, 5)
     {
+        // in case the device stops answering mid import we still add what we got
+        fTrezorImportTimer.setSingleShot(true);
+        fTrezorImportTimer.setInterval(2000);
+        connect(&fTrezorImportTimer, &QTimer::timeout, this, &AccountModel::flushTrezorImport);
+
         connect(&ipc, &NodeIPC::connectToServerDone, this, &AccountModel::connectToServerDone);
         connect(&ipc, &NodeIPC::getAccountsDone, this, &AccountModel::getAccountsDone);
         connect(&ipc, &NodeIPC::newAccountDone, this, &AccountModel::newAccountDone);
@@ -48,8 +55,11 @@ namespace Etherwall {
 
         connect(&currencyModel, &CurrencyModel::currencyChanged, this, &AccountModel::currencyChanged);
 
-        connect(&trezor, &Trezor::TrezorDevice::initialized, this, &AccountModel::onTrezorInitialized);
-        connect(&trezor, &Trezor::TrezorDevice::addressRetrieved, this, &AccountModel::onTrezorAddressRetrieved);
+        connect(&trezor, &Trezor::DevicePool::initialized, this, &AccountModel::onTrezorInitialized);
+        connect(&trezor, &Trezor::DevicePool::addressRetrieved, this, &AccountModel::onTrezorAddressRetrieved);
+        // before anyone else hears of it, so a failed signature's nonce is free for whoever signs next
+        connect(&trezor, &Trezor::DevicePool::deviceFailure, this, &AccountModel::onTrezorFailure);
+        connect(&trezor, &Trezor::DevicePool::transactionReady, this, &AccountModel::onTrezorTransactionReady);
     }
 
     QHash<int, QByteArray> AccountModel::roleNames() const {
@@ -81,15 +91,18 @@ namespace Etherwall {
         const int row = index.row();
 
         if ( role == Qt::DisplayRole ) {
-            switch ( index.column() ) {
-                case 0: return fAccountList.at(row).value(DefaultRole);
-                case 1: return fAccountList.at(row).value(DeviceTypeRole);
-                case 2: return fAccountList.at(row).alias();
-                case 3: return fAccountList.at(row).hash();
-                case 4: return fAccountList.at(row).getBalanceFixed(2);
-            }
+            const AccountInfo& info = fAccountList.at(row);
+            return fDisplay.display(row, index.column(), [&]() -> QVariant {
+                switch ( index.column() ) {
+                    case 0: return info.value(DefaultRole);
+                    case 1: return info.value(DeviceTypeRole);
+                    case 2: return info.alias();
+                    case 3: return info.hash();
+                    case 4: return info.getBalanceFixed(2);
+                }
 
-            return "?";
+                return "?";
+            });
         } else {
             QVariant result = fAccountList.at(row).value(role);
             if ( role == BalanceRole ) {
@@ -177,15 +190,12 @@ namespace Etherwall {
     }
 
     void AccountModel::removeAccount(const QString& address) {
-        QSettings settings;
         const QString key = address.toLower();
 
         beginResetModel();
 
         const QString chain = fIpc.chainManager().networkPostfix();
-        settings.beginGroup("accounts" + chain);
-        settings.remove(key);
-        settings.endGroup();
+        SettingsStore::remove("accounts" + chain + "/" + key);
 
         for ( int i = 0; i < fAccountList.size(); i++ ) {
             if ( fAccountList.at(i).hash().toLower() == key ) {
@@ -217,7 +227,8 @@ namespace Etherwall {
     quint64 AccountModel::getAccountNonce(int index) const
     {
         if ( index >= 0 && fAccountList.length() > index ) {
-            return fAccountList.at(index).transactionCount() + fIpc.nonceStart();
+            const AccountInfo& info = fAccountList.at(index);
+            return fNonces.next(info.hash(), info.transactionCount() + fIpc.nonceStart());
         }
 
         return 0; // TODO: throw
@@ -260,11 +271,8 @@ namespace Etherwall {
     void AccountModel::setAsDefault(const QString &address)
     {
         const int prevIndex = getDefaultIndex();
-        QSettings settings;
-        const QString defaultKey = "default/" + fIpc.chainManager().networkPostfix();
-        settings.beginGroup("accounts");
-        settings.setValue(defaultKey, address.toLower());
-        settings.endGroup();
+        const QString defaultKey = "accounts/default/" + fIpc.chainManager().networkPostfix();
+        SettingsStore::setValue(defaultKey, address.toLower());
 
         const int newIndex = getDefaultIndex();
         emit defaultIndexChanged(newIndex);
@@ -284,11 +292,39 @@ namespace Etherwall {
         const QString hdPathBase = fIpc.chainManager().hdPathBase();
         quint32 total = offset + count;
 
+        QList<Trezor::HDPath> hdPaths;
         for ( quint32 i = offset; i < total; i++ ) {
             const QString fullPath = hdPathBase + "/" + QString::number(i);
-            const Trezor::HDPath hdPath(fullPath);
-            fTrezor.getAddress(hdPath);
+            hdPaths.append(Trezor::HDPath(fullPath));
+        }
+
+        const QString deviceID = fTrezor.getDeviceID(); // the one that just got plugged in
+        if ( !deviceID.isEmpty() ) {
+            fTrezorImportsPending[deviceID] += hdPaths.size();
+        }
+        fTrezor.getAddresses(deviceID, hdPaths);
+    }
+
+    quint64 AccountModel::signTransaction(quint32 chainID, const QString& hdPath, const QString& from, const QString& to,
+                                          const QString& valStr, quint64 nonce, const QString& gas, const QString& gasPrice,
+                                          const QString& data)
+    {
+        QString deviceID = getAccountDeviceID(from);
+        if ( deviceID.isEmpty() ) {
+            deviceID = fTrezor.getDeviceID();
+        }
+
+        quint64 nodeNonce = nonce;
+        try {
+            nodeNonce = fAccountList.at(getAccountIndex(from)).transactionCount() + fIpc.nonceStart();
+        } catch ( QString err ) {
+            Q_UNUSED(err) // not one of ours, go with the caller's
         }
+
+        const quint64 reserved = fNonces.reserve(from, nodeNonce, deviceID);
+        fSigningTags.insert(from.toLower(), deviceID); // commit has only the signed tx to go by
+        fTrezor.signTransaction(deviceID, chainID, hdPath, from, to, valStr, reserved, gas, gasPrice, data);
+        return reserved;
     }
 
     const QString AccountModel::getMaxTokenValue(int accountIndex, const QString &tokenAddress) const
@@ -316,9 +352,7 @@ namespace Etherwall {
             QVector<int> roles(2);
             roles[0] = TokenBalanceRole;
             roles[1] = Qt::DisplayRole;
-            const QModelIndex& leftIndex = QAbstractTableModel::createIndex(accountIndex, 0);
-            const QModelIndex& rightIndex = QAbstractTableModel::createIndex(accountIndex, 5);
-            emit dataChanged(leftIndex, rightIndex, roles);
+            fChanges.rowChanged(accountIndex, roles);
             emit totalChanged();
         }
     }
@@ -404,6 +438,18 @@ namespace Etherwall {
         throw QString("Account not found");
     }
 
+    const QString AccountModel::getAccountDeviceID(const QString& address) const
+    {
+        const QString addressLower = address.toLower();
+        foreach ( const AccountInfo& info, fAccountList ) {
+            if ( info.hash().toLower() == addressLower ) {
+                return info.deviceID();
+            }
+        }
+
+        return QString(); // pool falls back to the current device
+    }
+
     void AccountModel::selectToken(const QString& name, const QString& tokenAddress)
     {
         fCurrentToken = name;
@@ -499,30 +545,99 @@ namespace Etherwall {
         emit promptForTrezorImport();
     }
 
-    void AccountModel::onTrezorAddressRetrieved(const QString &address, const QString& hdPath)
+    void AccountModel::onTrezorAddressRetrieved(const QString &address, const QString& hdPath, const QString& deviceID)
     {
-        int i1, i2;
-        if ( !containsAccount(address, "unused", i1, i2) ) {
-            beginInsertRows(QModelIndex(), fAccountList.size(), fAccountList.size());
-            fAccountList.append(AccountInfo(address, QString(), fTrezor.getDeviceID(), EMPTY_BALANCE, 0, hdPath, fIpc.chainManager().chainID()));
-            fAccountList.last().setCurrentTokenAddress(fCurrentTokenAddress);
-            endInsertRows();
-            fIpc.refreshAccount(address, fAccountList.size() - 1); // refresh ETH
-            emit existingAccountImported(Helpers::vitalizeAddress(address), fAccountList.size() - 1); // refresh ERC20 (all), NOTE: needs to be vitalized!
+        TrezorImport imported;
+        imported.fAddress = address;
+        imported.fHDPath = hdPath;
+        imported.fDeviceID = deviceID;
+        fTrezorImports.append(imported);
+        if ( --fTrezorImportsPending[deviceID] <= 0 ) {
+            fTrezorImportsPending.remove(deviceID);
+        }
 
-            storeAccountList();
-        } else if ( fAccountList.at(i1).deviceID() != fTrezor.getDeviceID() ) { // this shouldn't happen unless they reimported to another hd device
-            fAccountList[i1].setDeviceID(fTrezor.getDeviceID());
+        if ( fTrezorImportsPending.isEmpty() ) {
+            flushTrezorImport();
+        } else {
+            fTrezorImportTimer.start(); // a late device gets flushed in batches, not one by one
+        }
+    }
 
-            QVector<int> roles(2);
-            roles[0] = TokenBalanceRole;
-            roles[1] = DeviceRole;
-            const QModelIndex& leftIndex = QAbstractTableModel::createIndex(i1, i1);
-            const QModelIndex& rightIndex = QAbstractTableModel::createIndex(i1, i1);
-            emit dataChanged(leftIndex, rightIndex, roles);
+    void AccountModel::onTrezorFailure(const QString& deviceID, const QString& error)
+    {
+        Q_UNUSED(error)
+        fNonces.release(deviceID);
+
+        // the rest of its addresses won't come, add what we got if nobody else is importing
+        if ( fTrezorImportsPending.remove(deviceID) > 0 && fTrezorImportsPending.isEmpty() ) {
+            flushTrezorImport();
+        }
+
+        QMutableMapIterator<QString, QString> tags(fSigningTags);
+        while ( tags.hasNext() ) {
+            if ( tags.next().value() == deviceID ) {
+                tags.remove();
+            }
         }
     }
 
+    void AccountModel::onTrezorTransactionReady(const Ethereum::Tx& tx)
+    {
+        const QString tag = fSigningTags.take(tx.fromStr().toLower());
+        if ( !tag.isEmpty() ) {
+            fNonces.commit(tag);
+        }
+    }
+
+    void AccountModel::flushTrezorImport()
+    {
+        fTrezorImportTimer.stop(); // pending counts stay, so what's still coming keeps batching
+
+        AccountList added;
+        QStringList addedAddresses;
+        for ( int i = 0; i < fTrezorImports.size(); i++ ) {
+            const QString address = fTrezorImports.at(i).fAddress;
+            const QString hdPath = fTrezorImports.at(i).fHDPath;
+            const QString deviceID = fTrezorImports.at(i).fDeviceID;
+            int i1, i2;
+            if ( !containsAccount(address, "unused", i1, i2) ) {
+                if ( addedAddresses.contains(address) ) {
+                    continue;
+                }
+
+                added.append(AccountInfo(address, QString(), deviceID, EMPTY_BALANCE, 0, hdPath, fIpc.chainManager().chainID()));
+                added.last().setCurrentTokenAddress(fCurrentTokenAddress);
+                addedAddresses.append(address);
+            } else if ( fAccountList.at(i1).deviceID() != deviceID ) { // this shouldn't happen unless they reimported to another hd device
+                fAccountList[i1].setDeviceID(deviceID);
+
+                QVector<int> roles(2);
+                roles[0] = TokenBalanceRole;
+                roles[1] = DeviceRole;
+                fChanges.rowChanged(i1, roles);
+            }
+        }
+        fTrezorImports.clear();
+
+        if ( added.isEmpty() ) {
+            return;
+        }
+
+        // one model update for the whole import
+        const int first = fAccountList.size();
+        beginInsertRows(QModelIndex(), first, first + added.size() - 1);
+        fAccountList.append(added);
+        endInsertRows();
+
+        for ( int i = first; i < fAccountList.size(); i++ ) {
+            const QString address = fAccountList.at(i).hash();
+            fIpc.refreshAccount(address, i); // refresh ETH
+            emit existingAccountImported(Helpers::vitalizeAddress(address), i); // refresh ERC20 (all), NOTE: needs to be vitalized!
+        }
+
+        storeAccountList();
+    }
+
     void AccountModel::connectToServerDone() {
         loadAccountList();
         fIpc.getAccounts();
@@ -548,10 +663,7 @@ namespace Etherwall {
         QVector<int> roles(2);
         roles[0] = BalanceRole;
         roles[1] = Qt::DisplayRole;
-
-        const QModelIndex& leftIndex = QAbstractTableModel::createIndex(0, 0);
-        const QModelIndex& rightIndex = QAbstractTableModel::createIndex(fAccountList.size() - 1, 4);
-        emit dataChanged(leftIndex, rightIndex, roles);
+        fChanges.rowsChanged(0, fAccountList.size() - 1, roles);
         emit totalChanged();
     }
 
@@ -562,6 +674,7 @@ namespace Etherwall {
     }
 
     void AccountModel::getAccountsDone(const QStringList& list) {
+        RpcMetrics::Span span("AccountModel::getAccountsDone");
         beginResetModel();
         foreach ( const QString& addr, list ) {
             int i1, i2;
@@ -611,9 +724,7 @@ namespace Etherwall {
         }
 
         fAccountList[index].setBalance(balanceStr);
-        const QModelIndex& leftIndex = QAbstractTableModel::createIndex(index, 0);
-        const QModelIndex& rightIndex = QAbstractTableModel::createIndex(index, 4);
-        emit dataChanged(leftIndex, rightIndex);
+        fChanges.rowChanged(index);
         emit totalChanged();
     }
 
@@ -624,12 +735,12 @@ namespace Etherwall {
         }
 
         fAccountList[index].setTransactionCount(count);
-        const QModelIndex& leftIndex = QAbstractTableModel::createIndex(index, 0);
-        const QModelIndex& rightIndex = QAbstractTableModel::createIndex(index, 4);
-        emit dataChanged(leftIndex, rightIndex);
+        fNonces.update(fAccountList.at(index).hash(), count + fIpc.nonceStart());
+        fChanges.rowChanged(index);
     }
 
     void AccountModel::newBlock(const QJsonObject& block) {
+        RpcMetrics::Span span("AccountModel::newBlock");
         const QJsonArray transactions = block.value("transactions").toArray();
         const QString miner = block.value("miner").toString("bogus").toLower();
         int i1, i2;
@@ -663,9 +774,8 @@ namespace Etherwall {
 
     int AccountModel::getDefaultIndex() const
     {
-        const QSettings settings;
         const QString defaultKey = "accounts/default/" + fIpc.chainManager().networkPostfix();
-        const QString address = settings.value(defaultKey).toString().toLower();
+        const QString address = SettingsStore::value(defaultKey).toString().toLower();
 
         if ( address.isEmpty() ) {
             return 0;
@@ -682,9 +792,8 @@ namespace Etherwall {
 
     bool AccountModel::hasDefaultIndex() const
     {
-        const QSettings settings;
         const QString defaultKey = "accounts/default/" + fIpc.chainManager().networkPostfix();
-        const QString address = settings.value(defaultKey).toString();
+        const QString address = SettingsStore::value(defaultKey).toString();
         if ( address.isEmpty() ) {
             return false;
         }
@@ -709,10 +818,7 @@ namespace Etherwall {
 
     void AccountModel::storeAccountList() const
     {
-        QSettings settings;
-
-        const QString chain = fIpc.chainManager().networkPostfix();
-        settings.beginGroup("accounts" + chain);
+        const QString group = "accounts" + fIpc.chainManager().networkPostfix() + "/";
         int index = 0;
         foreach ( const AccountInfo& addr, fAccountList ) {
             const QString key = addr.hash().toLower();
@@ -722,39 +828,60 @@ namespace Etherwall {
             const QJsonDocument doc(json);
             const QString serialized = doc.toJson(QJsonDocument::Compact);
 
-            settings.setValue(key, serialized);
+            SettingsStore::setValue(group + key, serialized);
         }
-        settings.endGroup();
     }
 
-    void AccountModel::loadAccountList()
+    void AccountModel::restoreSnapshot(const AccountList& accounts)
     {
-        QSettings settings;
+        beginResetModel();
+        fAccountList = accounts;
+        foreach ( const AccountInfo& info, fAccountList ) {
+            setAccountAlias(info.hash(), info.alias());
+        }
+        endResetModel();
 
-        const QString chain = fIpc.chainManager().networkPostfix();
-        settings.beginGroup("accounts" + chain);
-        const QStringList keys = settings.allKeys();
+        emit totalChanged();
+    }
+
+    void AccountModel::loadAccountList()
+    {
+        const QString group = "accounts" + fIpc.chainManager().networkPostfix();
+        const QStringList keys = SettingsStore::keys(group);
         QList<QJsonObject> parsedList;
 
         foreach ( const QString& key, keys ) {
-            const QString serialized = settings.value(key, "invalid").toString();
+            const QString serialized = SettingsStore::value(group + "/" + key, "invalid").toString();
             parsedList.append(QJsonDocument::fromJson(serialized.toUtf8()).object());
         }
-        settings.endGroup();
 
         // SORT parsed list based on index
         std::sort(parsedList.begin(), parsedList.end(), [](const QJsonObject& a, const QJsonObject& b) {
             return a.value("index").toInt() < b.value("index").toInt();
         });
 
+        // keep balances shown from the snapshot until the node refreshes them
+        QMap<QString, AccountInfo> cached;
+        foreach ( const AccountInfo& info, fAccountList ) {
+            cached.insert(info.hash().toLower(), info);
+        }
+
+        beginResetModel();
+        fAccountList.clear();
         foreach ( const QJsonObject json, parsedList ) {
             const QString hash = json.value("hash").toString();
             const QString alias = json.value("alias").toString();
             const QString deviceID = json.value("deviceID").toString();
             const QString hdPath = json.value("HDPath").toString();
-            fAccountList.append(AccountInfo(hash, alias, deviceID, EMPTY_BALANCE, 0, hdPath, fIpc.chainManager().chainID()));
+            const QMap<QString, AccountInfo>::const_iterator it = cached.constFind(hash.toLower());
+            if ( it != cached.constEnd() ) {
+                fAccountList.append(it.value());
+            } else {
+                fAccountList.append(AccountInfo(hash, alias, deviceID, EMPTY_BALANCE, 0, hdPath, fIpc.chainManager().chainID()));
+            }
             setAccountAlias(hash, alias);
         }
+        endResetModel();
     }
 
     void AccountModel::setAccountAlias(const QString &hash, const QString &alias)
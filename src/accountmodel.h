@@ -28,11 +28,15 @@
 #include <QJsonValue>
 #include <QMap>
 #include <QUrl>
+#include <QTimer>
 #include "types.h"
 #include "currencymodel.h"
 #include "nodeipc.h"
 #include "etherlog.h"
-#include "trezor/trezor.h"
+#include "trezor/devicepool.h"
+#include "noncemanager.h"
+#include "changecoalescer.h"
+#include "rowcache.h"
 
 namespace Etherwall {
 
@@ -52,7 +56,7 @@ namespace Etherwall {
         Q_PROPERTY(int defaultIndex READ getDefaultIndex NOTIFY defaultIndexChanged)
         Q_PROPERTY(QString currentToken READ getCurrentToken NOTIFY currentTokenChanged)
     public:
-        AccountModel(NodeIPC& ipc, const CurrencyModel& currencyModel, Trezor::TrezorDevice& trezor);
+        AccountModel(NodeIPC& ipc, const CurrencyModel& currencyModel, Trezor::DevicePool& trezor, NonceManager& nonceManager);
         QString getError() const;
         QHash<int, QByteArray> roleNames() const;
         int rowCount(const QModelIndex & parent = QModelIndex()) const;
@@ -73,7 +77,9 @@ namespace Etherwall {
         const AccountList& getAccounts() const;
         const QVariantList getAccountAddresses() const;
         int getAccountIndex(const QString& address) const;
+        const QString getAccountDeviceID(const QString& address) const;
         void selectToken(const QString& name, const QString& tokenAddress);
+        void restoreSnapshot(const AccountList& accounts);
 
         Q_INVOKABLE void newAccount(const QString& pw);
         Q_INVOKABLE void renameAccount(const QString& name, int index);
@@ -87,6 +93,13 @@ namespace Etherwall {
         Q_INVOKABLE bool exportAccount(const QUrl& fileName, int index);
         Q_INVOKABLE void setAsDefault(const QString& address);
         Q_INVOKABLE void trezorImport(quint32 offset, quint8 count);
+        // signs on whichever connected TREZOR the from account was imported from, values in ether.
+        // the nonce is reserved from the node's count, so gaps left by failed signatures are refilled.
+        // nonce is the caller's view and only used for accounts we don't know, returns the one signed with
+        Q_INVOKABLE quint64 signTransaction(quint32 chainID, const QString& hdPath, const QString& from, const QString& to,
+                                         const QString& valStr, quint64 nonce,
+                                         const QString& gas = QString(), const QString& gasPrice = QString(),
+                                         const QString& data = QString());
         Q_INVOKABLE const QString getMaxTokenValue(int accountIndex, const QString& tokenAddress) const;
     public slots:
         void onTokenBalanceDone(int accountIndex, const QString& tokenAddress, const QString& balance);
@@ -101,7 +114,11 @@ namespace Etherwall {
         void syncingChanged(bool syncing);
         void importWalletDone();
         void onTrezorInitialized(const QString& deviceID);
-        void onTrezorAddressRetrieved(const QString& address, const QString& hdPath);
+        void onTrezorAddressRetrieved(const QString& address, const QString& hdPath, const QString& deviceID);
+        void onTrezorFailure(const QString& deviceID, const QString& error);
+        void onTrezorTransactionReady(const Ethereum::Tx& tx);
+    private slots:
+        void flushTrezorImport();
     signals:
         void accountsReady() const;
         void accountSelectionChanged(int) const;
@@ -116,16 +133,29 @@ namespace Etherwall {
         void currentTokenChanged() const;
         void existingAccountImported(const QString& address, int accountIndex) const;
     private:
+        struct TrezorImport {
+            QString fAddress;
+            QString fHDPath;
+            QString fDeviceID;
+        };
+
         NodeIPC& fIpc;
         AccountList fAccountList;
         QMap<QString, QString> fAliasMap;
-        Trezor::TrezorDevice& fTrezor;
+        Trezor::DevicePool& fTrezor;
+        NonceManager& fNonces;
         int fSelectedAccountRow;
         QString fSelectedAccount;
         const CurrencyModel& fCurrencyModel;
         bool fBusy;
         QString fCurrentToken;
         QString fCurrentTokenAddress;
+        QList<TrezorImport> fTrezorImports;
+        QMap<QString, int> fTrezorImportsPending; // per device, addresses asked for and not retrieved yet
+        QTimer fTrezorImportTimer;
+        QMap<QString, QString> fSigningTags; // lowercase sender -> tag its nonce is reserved under
+        ChangeCoalescer fChanges;
+        mutable RowCache fDisplay; // filled from data()
 
         int getSelectedAccountRow() const;
         int getDefaultIndex() const;
@@ -0,0 +1,103 @@
+#include "changecoalescer.h"
+#include <algorithm>
+
+namespace Etherwall {
+
+    const int COALESCE_INTERVAL = 16; // ms, one frame at 60Hz
+
+    ChangeCoalescer::ChangeCoalescer(QAbstractItemModel& model) : QObject(nullptr),
+        fModel(model), fDirty(), fTimer()
+    {
+        fTimer.setSingleShot(true);
+        fTimer.setInterval(COALESCE_INTERVAL);
+        connect(&fTimer, &QTimer::timeout, this, &ChangeCoalescer::flush);
+
+        connect(&fModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &ChangeCoalescer::flush);
+        connect(&fModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &ChangeCoalescer::flush);
+        connect(&fModel, &QAbstractItemModel::rowsAboutToBeMoved, this, &ChangeCoalescer::flush);
+        connect(&fModel, &QAbstractItemModel::layoutAboutToBeChanged, this, &ChangeCoalescer::flush);
+        connect(&fModel, &QAbstractItemModel::modelAboutToBeReset, this, &ChangeCoalescer::clear); // everything gets re-read anyhow
+    }
+
+    void ChangeCoalescer::rowChanged(int row, const QVector<int>& roles)
+    {
+        rowsChanged(row, row, roles);
+    }
+
+    void ChangeCoalescer::rowsChanged(int first, int last, const QVector<int>& roles)
+    {
+        if ( first < 0 || last < first ) {
+            return;
+        }
+
+        // kept sorted so equal role sets of neighbouring rows compare equal
+        QVector<int> sorted = roles;
+        std::sort(sorted.begin(), sorted.end());
+        for ( int row = first; row <= last; row++ ) {
+            QMap<int, QVector<int> >::iterator it = fDirty.find(row);
+            if ( it == fDirty.end() ) {
+                fDirty.insert(row, sorted);
+            } else {
+                mergeRoles(it.value(), sorted);
+            }
+        }
+
+        if ( !fTimer.isActive() ) {
+            fTimer.start();
+        }
+    }
+
+    void ChangeCoalescer::flush()
+    {
+        fTimer.stop();
+        if ( fDirty.isEmpty() ) {
+            return;
+        }
+
+        const QMap<int, QVector<int> > dirty = fDirty;
+        fDirty.clear();
+
+        // rows the model no longer has are dropped, consecutive rows with the same roles make one range
+        const int rows = fModel.rowCount();
+        const int lastColumn = qMax(0, fModel.columnCount() - 1);
+        QMap<int, QVector<int> >::const_iterator it = dirty.constBegin();
+        while ( it != dirty.constEnd() && it.key() < rows ) {
+            const int first = it.key();
+            const QVector<int> roles = it.value();
+            int last = first;
+            ++it;
+            while ( it != dirty.constEnd() && it.key() == last + 1 && it.key() < rows && it.value() == roles ) {
+                last = it.key();
+                ++it;
+            }
+
+            emit fModel.dataChanged(fModel.index(first, 0), fModel.index(last, lastColumn), roles);
+        }
+    }
+
+    void ChangeCoalescer::clear()
+    {
+        fTimer.stop();
+        fDirty.clear();
+    }
+
+    void ChangeCoalescer::mergeRoles(QVector<int>& target, const QVector<int>& roles)
+    {
+        if ( target.isEmpty() ) {
+            return; // already all
+        }
+
+        if ( roles.isEmpty() ) {
+            target.clear();
+            return;
+        }
+
+        foreach ( int role, roles ) {
+            if ( !target.contains(role) ) {
+                target.append(role);
+            }
+        }
+        std::sort(target.begin(), target.end());
+    }
+
+}
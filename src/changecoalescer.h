@@ -0,0 +1,38 @@
+#ifndef CHANGECOALESCER_H
+#define CHANGECOALESCER_H
+
+#include <QObject>
+#include <QAbstractItemModel>
+#include <QMap>
+#include <QVector>
+#include <QTimer>
+
+namespace Etherwall {
+
+    // collects dirty rows and roles of a model and emits them as few dataChanged ranges
+    // as possible once per frame, so bursts of updates re-evaluate each delegate once.
+    // Pending changes go out right before any structural change so row numbers stay valid.
+    class ChangeCoalescer : public QObject
+    {
+        Q_OBJECT
+    public:
+        ChangeCoalescer(QAbstractItemModel& model);
+
+        // empty roles means all of them
+        void rowChanged(int row, const QVector<int>& roles = QVector<int>());
+        void rowsChanged(int first, int last, const QVector<int>& roles = QVector<int>());
+    public slots:
+        void flush();
+    private slots:
+        void clear();
+    private:
+        QAbstractItemModel& fModel;
+        QMap<int, QVector<int> > fDirty; // row to roles
+        QTimer fTimer;
+
+        static void mergeRoles(QVector<int>& target, const QVector<int>& roles);
+    };
+
+}
+
+#endif // CHANGECOALESCER_H
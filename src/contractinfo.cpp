@@ -49,6 +49,45 @@ namespace Etherwall {
         return fHash;
     }
 
+    bool FilterInfo::matches(const EventInfo& event) const
+    {
+        if ( fAddress.toLower() != event.address().toLower() ) {
+            return false;
+        }
+
+        // each topic position is either null (any), a single topic or a list of alternatives
+        const QStringList eventTopics = event.topics();
+        for ( int i = 0; i < fTopics.size(); i++ ) {
+            const QJsonValue topic = fTopics.at(i);
+            if ( topic.isNull() ) {
+                continue;
+            }
+
+            if ( i >= eventTopics.size() ) {
+                return false;
+            }
+
+            const QString eventTopic = eventTopics.at(i).toLower();
+            if ( topic.isArray() ) {
+                bool found = false;
+                foreach ( const QJsonValue alt, topic.toArray() ) {
+                    if ( alt.toString().toLower() == eventTopic ) {
+                        found = true;
+                        break;
+                    }
+                }
+
+                if ( !found ) {
+                    return false;
+                }
+            } else if ( topic.toString().toLower() != eventTopic ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     const QString FilterInfo::calculateHash() const
     {
         // md5 good enough here, not security related and we need speed
@@ -725,8 +764,19 @@ namespace Etherwall {
 
     // ***************************** EventInfo ***************************** //
 
+    // hex fields are kept as raw bytes in the binary form to halve their size
+    static const QByteArray hexToBytes(const QString& hex) {
+        const QString stripped = hex.startsWith("0x") ? hex.mid(2) : hex;
+        return QByteArray::fromHex(stripped.toLatin1());
+    }
+
+    static const QString bytesToHex(const QByteArray& bytes) {
+        return "0x" + QString::fromLatin1(bytes.toHex());
+    }
+
     EventInfo::EventInfo(const QJsonObject& source) : ResultInfo(source["data"].toString()) {
         fBlockNumber = Helpers::toQUInt64(source["blockNumber"]);
+        fLogIndex = Helpers::toQUInt64(source["logIndex"]);
         fBlockHash = source["blockHash"].toString();
         fAddress = Helpers::vitalizeAddress(source["address"].toString());
         fTransactionHash = source["transactionHash"].toString();
@@ -735,6 +785,40 @@ namespace Etherwall {
         foreach ( const QVariant v, topics ) {
             fTopics.append(v.toString());
         }
+        parseMethodID();
+    }
+
+    EventInfo::EventInfo(QDataStream& stream) : ResultInfo(QString()) {
+        QByteArray data;
+        QByteArray address;
+        QByteArray blockHash;
+        QByteArray transactionHash;
+        quint8 topicCount = 0;
+
+        stream >> data >> address >> fBlockNumber >> fLogIndex >> blockHash >> transactionHash >> topicCount;
+        fData = bytesToHex(data);
+        fAddress = Helpers::vitalizeAddress(bytesToHex(address));
+        fBlockHash = bytesToHex(blockHash);
+        fTransactionHash = bytesToHex(transactionHash);
+        fTopics = QStringList();
+        for ( int i = 0; i < topicCount; i++ ) {
+            QByteArray topic;
+            stream >> topic;
+            fTopics.append(bytesToHex(topic));
+        }
+        parseMethodID();
+    }
+
+    void EventInfo::write(QDataStream& stream) const {
+        stream << hexToBytes(fData) << hexToBytes(fAddress) << fBlockNumber << fLogIndex;
+        stream << hexToBytes(fBlockHash) << hexToBytes(fTransactionHash);
+        stream << (quint8)fTopics.size();
+        foreach ( const QString& topic, fTopics ) {
+            stream << hexToBytes(topic);
+        }
+    }
+
+    void EventInfo::parseMethodID() {
         fMethodID = QString("invalid");
         if ( fTopics.length() > 0 ) {
             fMethodID = fTopics.at(0);
@@ -754,8 +838,19 @@ namespace Etherwall {
     }
 
     const QString EventInfo::signature() const {
+        // canonical types from the ABI, values stay undecoded until someone looks at them
+        QStringList types;
+        foreach ( const ContractArg& arg, fArguments ) {
+            types.append(arg.type());
+        }
+
+        return fName + "(" + types.join(",") + ")";
+    }
+
+    const QString EventInfo::signature(const QVariantList& params) const {
+        // same with already decoded values in place of the types
         QStringList vals;
-        foreach ( const QVariant param, fParams ) {
+        foreach ( const QVariant param, params ) {
             vals.append(paramToStr(param));
         }
 
@@ -766,10 +861,18 @@ namespace Etherwall {
         return fTransactionHash;
     }
 
+    const QString EventInfo::blockHash() const {
+        return fBlockHash;
+    }
+
     const QString EventInfo::getMethodID() const {
         return fMethodID;
     }
 
+    const QStringList EventInfo::topics() const {
+        return fTopics;
+    }
+
     const QVariant EventInfo::value(const int role) const {
         switch ( role ) {
             case EventNameRole: return fName;
@@ -789,7 +892,22 @@ namespace Etherwall {
         return fBlockNumber;
     }
 
-    const QString EventInfo::getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data)
+    quint64 EventInfo::logIndex() const {
+        return fLogIndex;
+    }
+
+    int EventInfo::memorySize() const {
+        // rough estimate, good enough for the event retention cap
+        int chars = fData.size() + fAddress.size() + fTransactionHash.size() + fBlockHash.size();
+        chars += fMethodID.size() + fName.size() + fContract.size();
+        foreach ( const QString& topic, fTopics ) {
+            chars += topic.size();
+        }
+
+        return sizeof(EventInfo) + chars * sizeof(QChar) + fArguments.size() * sizeof(ContractArg);
+    }
+
+    const QString EventInfo::getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data) const
     {
         QString val;
         if ( arg.indexed() ) {
@@ -1125,26 +1243,10 @@ namespace Etherwall {
 
     void ResultInfo::fillParams(const ContractInfo &contract, const ContractCallable &source)
     {
+        // params are decoded on access, most results are never looked at
         fillContract(contract);
         fName = source.getName();
         fArguments = source.getArguments();
-
-        QString data = QString(fData);
-        data.remove(0, 2); // remove the 0x
-        int n = 0;
-        int t = 1;
-
-        foreach ( const ContractArg arg, source.getArguments() ) {
-            QString val = getValue(arg, t, n, data);
-
-            if ( arg.dynamic() ) { // value holds "pointer" to data in data
-                ulong ptr = arg.decodeInt(val, false).toUlong() * 2;
-                val = data.mid(ptr);
-                fParams.append(arg.decode(val));
-            } else { // value is direct
-                fParams.append(arg.decode(val));
-            }
-        }
     }
 
     const QString ResultInfo::contract() const
@@ -1152,7 +1254,7 @@ namespace Etherwall {
         return fContract;
     }
 
-    const QString ResultInfo::getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data)
+    const QString ResultInfo::getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data) const
     {
         Q_UNUSED(arg);
         Q_UNUSED(topicIndex);
@@ -1169,7 +1271,43 @@ namespace Etherwall {
     }
 
     const QVariantList ResultInfo::getParams() const {
-        return fParams;
+        QVariantList result;
+        const QString data = fData.mid(2); // remove the 0x
+        int n = 0;
+        int t = 1;
+
+        foreach ( const ContractArg arg, fArguments ) {
+            result.append(decodeValue(arg, getValue(arg, t, n, data), data));
+        }
+
+        return result;
+    }
+
+    const QVariant ResultInfo::getParam(int index) const {
+        if ( index < 0 || index >= fArguments.size() ) {
+            return QVariant();
+        }
+
+        const QString data = fData.mid(2); // remove the 0x
+        int n = 0;
+        int t = 1;
+
+        // skip over the preceding args without decoding them
+        for ( int i = 0; i < index; i++ ) {
+            getValue(fArguments.at(i), t, n, data);
+        }
+
+        const ContractArg arg = fArguments.at(index);
+        return decodeValue(arg, getValue(arg, t, n, data), data);
+    }
+
+    const QVariant ResultInfo::decodeValue(const ContractArg& arg, const QString& val, const QString& data) const {
+        if ( arg.dynamic() ) { // value holds "pointer" to data in data
+            ulong ptr = arg.decodeInt(val, false).toUlong() * 2;
+            return arg.decode(data.mid(ptr));
+        }
+
+        return arg.decode(val); // value is direct
     }
 
     const QString ResultInfo::paramToStr(const QVariant& value) const {
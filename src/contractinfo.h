@@ -8,6 +8,7 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QJsonDocument>
+#include <QDataStream>
 #include "ethereum/bigint.h"
 
 #include <QDebug>
@@ -22,6 +23,8 @@ namespace Etherwall {
         FilterActiveRole
     };
 
+    class EventInfo;
+
     class FilterInfo
     {
     public:
@@ -35,6 +38,7 @@ namespace Etherwall {
         void setActive(bool active);
         bool getActive() const;
         const QString getHash() const;
+        bool matches(const EventInfo& event) const;
     private:
         QString fName;
         QString fAddress;
@@ -173,37 +177,49 @@ namespace Etherwall {
         const QString contract() const;
         const ContractArgs getArguments() const;
         const QVariantList getParams() const;
+        const QVariant getParam(int index) const;
         const QString paramToStr(const QVariant& value) const;
     protected:
         QString fName;
         QString fContract;
         QString fData;
         ContractArgs fArguments;
-        QVariantList fParams;
 
-        virtual const QString getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data);
+        virtual const QString getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data) const;
+    private:
+        const QVariant decodeValue(const ContractArg& arg, const QString& val, const QString& data) const;
     };
 
     class EventInfo : public ResultInfo
     {
     public:
         EventInfo(const QJsonObject& source);
+        EventInfo(QDataStream& stream);
         virtual ~EventInfo();
         const QString address() const;
         const QString signature() const;
+        const QString signature(const QVariantList& params) const;
         const QString transactionHash() const;
+        const QString blockHash() const;
         const QString getMethodID() const;
+        const QStringList topics() const;
         const QVariant value(const int role) const;
         quint64 blockNumber() const;
+        quint64 logIndex() const;
+        int memorySize() const;
+        void write(QDataStream& stream) const;
     protected:
-        virtual const QString getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data);
+        virtual const QString getValue(const ContractArg arg, int &topicIndex, int &index, const QString &data) const;
     private:
         QString fAddress;
         quint64 fBlockNumber;
+        quint64 fLogIndex;
         QString fTransactionHash;
         QString fBlockHash;
         QString fMethodID;
         QStringList fTopics;
+
+        void parseMethodID();
     };
 
     typedef QList<EventInfo> EventList;
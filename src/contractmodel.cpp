@@ -19,9 +19,10 @@
  */
 
 #include "contractmodel.h"
-#include "etherlog.h"
+#include "etherlogapp.h"
 #include "helpers.h"
-#include <QSettings>
+#include "rpcmetrics.h"
+#include "settingsstore.h"
 #include <QJsonDocument>
 #include <QDebug>
 
@@ -40,11 +41,19 @@ namespace Etherwall {
     // contract model
 
     ContractModel::ContractModel(NodeIPC& ipc, AccountModel& accountModel) : QAbstractTableModel(nullptr),
-        fList(), fIpc(ipc), fNetManager(), fBusy(false), fPendingContracts(), fAccountModel(accountModel), fTokenBalanceTabs()
+        fList(), fIpc(ipc), fNetManager(), fBusy(false), fPendingContracts(), fAccountModel(accountModel), fTokenBalanceTabs(),
+        fPendingEvents(), fEventTimer(), fLogsFailed(false), fChanges(*this)
     {
-        connect(&accountModel, &AccountModel::accountsReady, this, &ContractModel::reload);
+        // getLogs replies arrive one log at a time, collect them and pass them on in batches
+        fEventTimer.setSingleShot(true);
+        fEventTimer.setInterval(50);
+        connect(&fEventTimer, &QTimer::timeout, this, &ContractModel::flushEvents);
+
         connect(&accountModel, &AccountModel::existingAccountImported, this, &ContractModel::onExistingAccountImported);
         connect(&ipc, &NodeIPC::newEvent, this, &ContractModel::onNewEvent);
+        // the active request is only readable while NodeIPC is still on it
+        connect(&ipc, &NodeIPC::requestDone, this, &ContractModel::onRequestDone, Qt::DirectConnection);
+        connect(&ipc, &NodeIPC::error, this, &ContractModel::onRequestError, Qt::DirectConnection);
         connect(&ipc, &NodeIPC::callDone, this, &ContractModel::onCallDone);
         connect(&ipc, &NodeIPC::newAccountDone, this, &ContractModel::registerTokensFilter);
         connect(&fNetManager, SIGNAL(finished(QNetworkReply*)), this, SLOT(httpRequestDone(QNetworkReply*)));
@@ -104,14 +113,12 @@ namespace Etherwall {
 
         const ContractInfo info(name, address, jsonDoc.array());
 
-        QSettings settings;
+        const QString group = "contracts" + fIpc.chainManager().networkPostfix() + "/";
         const QString lowerAddr = info.value(AddressRole).toString().toLower();
-        settings.beginGroup("contracts" + fIpc.chainManager().networkPostfix());
-        if ( settings.contains(info.value(AddressRole).toString()) ) { // we didn't lowercase before
-            settings.remove(info.value(AddressRole).toString());
+        if ( SettingsStore::contains(group + info.value(AddressRole).toString()) ) { // we didn't lowercase before
+            SettingsStore::remove(group + info.value(AddressRole).toString());
         }
-        settings.setValue(lowerAddr, info.toJsonString());
-        settings.endGroup();
+        SettingsStore::setValue(group + lowerAddr, info.toJsonString());
 
         int at = 0;
         foreach ( const ContractInfo li, fList ) {
@@ -178,11 +185,9 @@ namespace Etherwall {
             return false;
         }
 
-        QSettings settings;
-        settings.beginGroup("contracts" + fIpc.chainManager().networkPostfix());
-        settings.remove(fList.at(index).address()); // we didn't lowercase before
-        settings.remove(fList.at(index).address().toLower());
-        settings.endGroup();
+        const QString group = "contracts" + fIpc.chainManager().networkPostfix() + "/";
+        SettingsStore::remove(group + fList.at(index).address()); // we didn't lowercase before
+        SettingsStore::remove(group + fList.at(index).address().toLower());
 
         beginRemoveRows(QModelIndex(), index, index);
         if ( fList.at(index).isERC20() ) { // remove watch for token
@@ -414,7 +419,7 @@ namespace Etherwall {
         }
         const QByteArray data = QJsonDocument(objectJson).toJson();
 
-        EtherLog::logMsg("HTTP Post request: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post request: " + data; });
 
         fNetManager.post(request, data);
         fBusy = true;
@@ -466,67 +471,71 @@ namespace Etherwall {
     }
 
     void ContractModel::reload() {
-        QSettings settings;
-        settings.beginGroup("contracts" + fIpc.chainManager().networkPostfix());
-        const QStringList list = settings.allKeys();
+        RpcMetrics::Span span("ContractModel::reload");
+        const QString group = "contracts" + fIpc.chainManager().networkPostfix();
+        const QStringList list = SettingsStore::keys(group);
 
-        beginResetModel();
-        int index = 0;
+        ContractList contracts;
         foreach ( const QString addr, list ) {
             QJsonParseError parseError;
-            const QString val = settings.value(addr).toString();
+            const QString val = SettingsStore::value(group + "/" + addr).toString();
             const QJsonDocument jsonDoc = QJsonDocument::fromJson(val.toUtf8(), &parseError);
 
             if ( parseError.error != QJsonParseError::NoError ) {
                 EtherLog::logMsg("Error parsing stored contract: " + parseError.errorString(), LS_Error);
             } else {
                 const ContractInfo info(jsonDoc.object());
-                fList.append(info);
-                if ( info.needsERC20Init() ) {
-                    loadERC20Data(info, index);
-                } else if ( info.isERC20() ) {
-                    onSelectedTokenContract(index, false); // get balances but don't select given token for accounts
-                }
-
-                index++;
+                contracts.append(info);
             }
         }
 
-        settings.endGroup();
+        // replaces what the snapshot showed, if anything
+        beginResetModel();
+        fList = contracts;
         endResetModel();
 
         registerTokensFilter();
     }
 
-    void ContractModel::onNewEvent(const QJsonObject& event, bool isNew, const QString& internalFilterID) {
-        EventInfo info(event);
-        int contractIndex = 0;
-        bool found = false;
-        // find the right contract and process/fill the params
-        foreach ( const ContractInfo ci, fList ) {
-            if ( ci.address() == info.address() ) {
-                ci.processEvent(info);
-                found = true;
-                break;
+    const ContractList& ContractModel::getContracts() const {
+        return fList;
+    }
+
+    void ContractModel::restoreSnapshot(const ContractList& contracts) {
+        beginResetModel();
+        fList = contracts;
+        endResetModel();
+    }
+
+    void ContractModel::refreshTokens() {
+        for ( int index = 0; index < fList.size(); index++ ) {
+            const ContractInfo& info = fList.at(index);
+            if ( info.needsERC20Init() ) {
+                loadERC20Data(info, index);
+            } else if ( info.isERC20() ) {
+                onSelectedTokenContract(index, false); // get balances but don't select given token for accounts
             }
-            contractIndex++;
         }
+    }
+
+    void ContractModel::onNewEvent(const QJsonObject& event, bool isNew, const QString& internalFilterID) {
+        EventInfo info(event);
+        const int contractIndex = processEvent(info);
 
-        if ( !found ) {
+        if ( contractIndex < 0 ) {
             return EtherLog::logMsg("Contract for event not found", LS_Error);
         }
 
         if ( internalFilterID == "tokensFilter" ) {
             const AccountList& accounts = fAccountModel.getAccounts();
             const ContractInfo& contract = fList.at(contractIndex);
-            const QVariantList params = info.getParams();
-            if ( params.size() < 3 ) {
-                return EtherLog::logMsg("Invalid amount of Transfer event params: " + QString::number(params.size()), LS_Error);
+            const int paramCount = info.getArguments().size();
+            if ( paramCount < 3 ) {
+                return EtherLog::logMsg("Invalid amount of Transfer event params: " + QString::number(paramCount), LS_Error);
             }
 
-            const QString fromAddress = params.at(0).toString().toLower();
-            const QString toAddress = params.at(1).toString().toLower();
-            const QString value = Helpers::baseStrToFullStr(params.at(2).toString(), contract.decimals());
+            // only the recipient is needed to find out if it's ours
+            const QString toAddress = info.getParam(1).toString().toLower();
 
             // call balance for given account
             for ( int accountIndex = 0; accountIndex < accounts.size(); accountIndex++ ) {
@@ -535,18 +544,92 @@ namespace Etherwall {
                     continue;
                 }
 
+                const QString fromAddress = info.getParam(0).toString().toLower();
+                const QString value = Helpers::baseStrToFullStr(info.getParam(2).toString(), contract.decimals());
                 refreshTokenBalance(accountAddress, accountIndex, contract, contractIndex);
                 fIpc.getTransactionByHash(info.transactionHash()); // get the TX so we know which one it came from
                 emit receivedTokens(value, contract.token(), fromAddress);
                 break;
             }
         } else if ( internalFilterID == "watchFilter" ) {
-            emit newEvent(info, isNew);
+            if ( isNew ) {
+                emit newEvent(info, isNew);
+            } else { // historical logs from getLogs
+                fPendingEvents.append(info);
+                if ( !fEventTimer.isActive() ) {
+                    fEventTimer.start();
+                }
+            }
         } else {
             return EtherLog::logMsg("Unknown internal filterID: " + internalFilterID, LS_Error);
         }
     }
 
+    const EventList ContractModel::processEvents(const EventList& events) const
+    {
+        RpcMetrics::Span span("ContractModel::processEvents");
+        EventList result;
+        result.reserve(events.size());
+        foreach ( EventInfo info, events ) {
+            if ( processEvent(info) >= 0 ) { // skip events whose contract was deleted
+                result.append(info);
+            }
+        }
+
+        return result;
+    }
+
+    int ContractModel::processEvent(EventInfo& info) const
+    {
+        // find the right contract and process/fill the params
+        for ( int i = 0; i < fList.size(); i++ ) {
+            const ContractInfo& ci = fList.at(i);
+            if ( ci.address() == info.address() ) {
+                ci.processEvent(info);
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    void ContractModel::flushEvents()
+    {
+        RpcMetrics::Span span("ContractModel::flushEvents");
+        if ( fPendingEvents.isEmpty() ) {
+            return;
+        }
+
+        const EventList batch = fPendingEvents;
+        fPendingEvents.clear();
+        emit newEvents(batch);
+    }
+
+    void ContractModel::onRequestDone()
+    {
+        if ( fIpc.getActiveRequestName() != "eth_getLogs" ) {
+            return;
+        }
+
+        // queued behind the reply's newEvent calls, so the batch is complete once this runs
+        const bool ok = !fLogsFailed;
+        fLogsFailed = false;
+        QMetaObject::invokeMethod(this, [this, ok]() {
+            flushEvents();
+            emit logsFetched(ok);
+        }, Qt::QueuedConnection);
+    }
+
+    void ContractModel::onRequestError()
+    {
+        const QString method = fIpc.getActiveRequestName();
+        if ( method == "eth_getLogs" ) {
+            fLogsFailed = true;
+        } else if ( method.isEmpty() ) { // bail clears the active request before reporting
+            QMetaObject::invokeMethod(this, [this]() { emit logsLost(); }, Qt::QueuedConnection);
+        }
+    }
+
     void ContractModel::httpRequestDone(QNetworkReply *reply) {
         QString err;
         const auto parsed = Helpers::parseHTTPReply(reply, err);
@@ -619,13 +702,10 @@ namespace Etherwall {
         }
 
         const ContractInfo info = fList.at(index);
-        QSettings settings;
         const QString lowerAddr = info.address().toLower();
-        settings.beginGroup("contracts" + fIpc.chainManager().networkPostfix());
-        settings.setValue(lowerAddr, info.toJsonString());
-        settings.endGroup();
+        SettingsStore::setValue("contracts" + fIpc.chainManager().networkPostfix() + "/" + lowerAddr, info.toJsonString());
 
-        emit dataChanged(QAbstractTableModel::createIndex(index, 0), QAbstractTableModel::createIndex(index, 0));
+        fChanges.rowChanged(index); // token loads come in bursts on startup
     }
 
     void ContractModel::onSelectedTokenContract(int index, bool forwardToAccounts)
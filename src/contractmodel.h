@@ -26,9 +26,11 @@
 #include <QNetworkAccessManager>
 #include <QVariantList>
 #include <QVariantMap>
+#include <QTimer>
 #include "contractinfo.h"
 #include "nodeipc.h"
 #include "accountmodel.h"
+#include "changecoalescer.h"
 
 namespace Etherwall {
 
@@ -74,10 +76,16 @@ namespace Etherwall {
         Q_INVOKABLE const QString encodeTopics(int index, const QString& eventName, const QVariantList& params);
         Q_INVOKABLE void requestAbi(const QString& address);
         Q_INVOKABLE bool callName(const QString& address, const QString& jsonAbi) const;
+        const EventList processEvents(const EventList& events) const;
+        const ContractList& getContracts() const;
+        void restoreSnapshot(const ContractList& contracts);
     signals:
         void error(const QString& error) const; // internal error
         void callError(const QString& err) const;
         void newEvent(const EventInfo& info, bool isNew) const;
+        void newEvents(const EventList& events) const;
+        void logsFetched(bool ok) const; // a getLogs reply was handled, its events went out with newEvents
+        void logsLost() const; // the node connection bailed, getLogs in flight won't be answered
         void abiResult(const QString& abi) const;
         void busyChanged(bool busy) const;
         void callNameDone(const QString& name) const;
@@ -85,12 +93,17 @@ namespace Etherwall {
         void receivedTokens(const QString& value, const QString& token, const QString& sender) const;
     public slots:
         void reload();
+        void refreshTokens();
         void onNewEvent(const QJsonObject& event, bool isNew, const QString& internalFilterID);
         void httpRequestDone(QNetworkReply *reply);
         void onCallDone(const QString& result, int index, const QVariantMap& userData);
         void onSelectedTokenContract(int index, bool forwardToAccounts = true);
         void onConfirmedTransaction(const QString &fromAddress, const QString& toAddress, const QString& hash);
         void onExistingAccountImported(const QString& address, int accountIndex);
+    private slots:
+        void flushEvents();
+        void onRequestDone();
+        void onRequestError();
     private:
         const QString getPostfix() const;
         void loadERC20Data(const ContractInfo& contract, int index) const;
@@ -99,6 +112,7 @@ namespace Etherwall {
         void onTokenBalance(const QString& result, int contractIndex, int accountIndex) const;
         void registerTokensFilter();
         const ContractInfo& getContractByAddress(const QString& address, int& index) const;
+        int processEvent(EventInfo& info) const;
 
         ContractList fList;
         NodeIPC& fIpc;
@@ -107,6 +121,10 @@ namespace Etherwall {
         PendingContracts fPendingContracts;
         AccountModel& fAccountModel;
         QMap<QString, bool> fTokenBalanceTabs;
+        EventList fPendingEvents;
+        QTimer fEventTimer;
+        bool fLogsFailed; // only touched from NodeIPC's reply handling
+        ChangeCoalescer fChanges;
     };
 
 }
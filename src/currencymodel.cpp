@@ -19,6 +19,7 @@
  */
 
 #include "currencymodel.h"
+#include "etherlogapp.h"
 #include <QDebug>
 #include <QSettings>
 #include <QJsonArray>
@@ -110,7 +111,7 @@ namespace Etherwall {
         objectJson["version"] = 2;
         const QByteArray data = QJsonDocument(objectJson).toJson();
 
-        EtherLog::logMsg("HTTP Post request: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post request: " + data; });
 
         fNetManager.post(request, data);
     }
@@ -123,7 +124,7 @@ namespace Etherwall {
         beginResetModel();
 
         const QByteArray data = reply->readAll();
-        EtherLog::logMsg("HTTP Post reply: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post reply: " + data; });
 
         QJsonParseError parseError;
         const QJsonDocument resDoc = QJsonDocument::fromJson(data, &parseError);
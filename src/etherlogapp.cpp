@@ -4,14 +4,93 @@
 
 namespace Etherwall {
 
-    EtherLogApp::EtherLogApp() : EtherLog()
+    const int LOG_REFRESH = 500; // ms between log view updates, only if something was logged
+
+    EtherLogApp* EtherLogApp::sApp = nullptr;
+    std::atomic<int> EtherLogApp::sLevel(LS_Debug);
+
+    EtherLogApp::EtherLogApp() : EtherLog(),
+        fRing("diagnostics/logFile", LOG_REFRESH), fTrimQueued(false), fTrimmable(true)
     {
+        // everything logged through EtherLog (incl. the node side) lands in the ring instead
+        connect(this, &QAbstractItemModel::rowsInserted, this, &EtherLogApp::onRowsInserted, Qt::DirectConnection);
 
+        // keep a copy of the level we can check from any thread
+        connect(this, &EtherLog::logLevelChanged, this, &EtherLogApp::onLogLevelChanged);
+        onLogLevelChanged();
+
+        sApp = this;
+    }
+
+    EtherLogApp::~EtherLogApp()
+    {
+        sApp = nullptr;
     }
 
     void EtherLogApp::saveToClipboard() const
     {
-         QApplication::clipboard()->setText(getContents());
+         QApplication::clipboard()->setText(fRing.render(sLevel.load(std::memory_order_relaxed)));
+    }
+
+    LogRing& EtherLogApp::ring()
+    {
+        return fRing;
+    }
+
+    bool EtherLogApp::enabled(LogSeverity severity)
+    {
+        return severity >= sLevel.load(std::memory_order_relaxed);
+    }
+
+    void EtherLogApp::onRowsInserted(const QModelIndex& parent, int first, int last)
+    {
+        for ( int row = first; row <= last; row++ ) {
+            const QModelIndex idx = index(row, 0, parent);
+            fRing.append(toSeverity(data(idx, SeverityRole)), data(idx, MsgRole).toString());
+        }
+
+        // not from in here, the base model may still be working on its rows after the insert
+        if ( fTrimmable && !fTrimQueued ) {
+            fTrimQueued = true;
+            QMetaObject::invokeMethod(this, &EtherLogApp::trim, Qt::QueuedConnection);
+        }
+    }
+
+    void EtherLogApp::onLogLevelChanged()
+    {
+        const int level = getLogLevel();
+        sLevel.store(level, std::memory_order_relaxed);
+        fRing.setLevel(level);
+    }
+
+    void EtherLogApp::trim()
+    {
+        // every row the base model holds is in the ring already, no need for a second copy
+        fTrimQueued = false;
+        if ( rowCount() > 0 && !removeRows(0, rowCount()) ) {
+            fTrimmable = false;
+            fRing.append(LS_Warning, "Log model doesn't support removing rows, it keeps its own copy");
+        }
+    }
+
+    int EtherLogApp::toSeverity(const QVariant& value)
+    {
+        bool ok = false;
+        const int severity = value.toInt(&ok);
+        if ( ok ) {
+            return severity;
+        }
+
+        const QString name = value.toString().toLower();
+        if ( name.startsWith("debug") ) {
+            return LS_Debug;
+        } else if ( name.startsWith("warn") ) {
+            return LS_Warning;
+        } else if ( name.startsWith("err") ) {
+            return LS_Error;
+        }
+
+        return LS_Info;
     }
 
 }
@@ -1,7 +1,9 @@
 #ifndef ETHERLOGAPP_H
 #define ETHERLOGAPP_H
 
+#include <atomic>
 #include "etherlog.h"
+#include "logring.h"
 
 namespace Etherwall {
 
@@ -10,8 +12,40 @@ namespace Etherwall {
         Q_OBJECT
     public:
         EtherLogApp();
+        virtual ~EtherLogApp();
 
         Q_INVOKABLE void saveToClipboard() const;
+        LogRing& ring();
+
+        static bool enabled(LogSeverity severity);
+
+        // formats only if the level lets the record through, e.g.
+        // EtherLogApp::log(LS_Debug, [&]() { return "Sent: " + msg; });
+        template<typename Formatter>
+        static void log(LogSeverity severity, Formatter format) {
+            if ( !enabled(severity) ) {
+                return;
+            }
+
+            if ( sApp != nullptr ) {
+                sApp->fRing.append(severity, format());
+            } else {
+                EtherLog::logMsg(format(), severity);
+            }
+        }
+    private slots:
+        void onRowsInserted(const QModelIndex& parent, int first, int last);
+        void onLogLevelChanged();
+        void trim();
+    private:
+        static EtherLogApp* sApp;
+        static std::atomic<int> sLevel;
+
+        LogRing fRing;
+        bool fTrimQueued;
+        bool fTrimmable; // cleared if the base model won't give up its rows
+
+        static int toSeverity(const QVariant& value);
     };
 }
 
@@ -0,0 +1,263 @@
+#include "eventcache.h"
+#include "etherlog.h"
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <algorithm>
+
+namespace Etherwall {
+
+    const quint32 EVENT_CACHE_MAGIC = 0x45574543; // "EWEC"
+    const quint32 EVENT_CACHE_VERSION = 1;
+
+    EventCache::EventCache() : fPath(), fCursors()
+    {
+    }
+
+    void EventCache::setNetwork(const QString& networkPostfix) {
+        const QString base = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        const QString path = QDir(base).filePath("events" + networkPostfix);
+        if ( path == fPath ) {
+            return;
+        }
+
+        fPath = path;
+        fCursors.clear();
+        if ( !QDir().mkpath(fPath) ) {
+            EtherLog::logMsg("Unable to create event cache directory: " + fPath, LS_Error);
+        }
+    }
+
+    bool EventCache::hasCursor(const QString& filterHash) const {
+        return fCursors.contains(filterHash);
+    }
+
+    quint64 EventCache::cursor(const QString& filterHash) const {
+        return fCursors.value(filterHash, 0);
+    }
+
+    void EventCache::setCursor(const QString& filterHash, quint64 block) {
+        fCursors[filterHash] = block;
+    }
+
+    void EventCache::resetCursor(const QString& filterHash) {
+        fCursors.remove(filterHash);
+    }
+
+    const EventList EventCache::load(const QString& filterHash) {
+        EventList result;
+        QFile file(fileName(filterHash));
+        if ( fPath.isEmpty() || !file.open(QIODevice::ReadOnly) ) {
+            return result; // nothing cached yet
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_6);
+        quint32 magic = 0;
+        quint32 version = 0;
+        quint64 cursor = 0;
+        quint32 count = 0;
+        stream >> magic >> version >> cursor >> count;
+
+        if ( magic != EVENT_CACHE_MAGIC || version != EVENT_CACHE_VERSION ) {
+            EtherLog::logMsg("Ignoring incompatible event cache file: " + file.fileName(), LS_Warning);
+            return result;
+        }
+
+        result.reserve(count);
+        for ( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++ ) {
+            result.append(EventInfo(stream));
+        }
+
+        if ( stream.status() != QDataStream::Ok ) {
+            EtherLog::logMsg("Corrupted event cache file: " + file.fileName(), LS_Warning);
+            return EventList();
+        }
+
+        fCursors[filterHash] = cursor;
+        return result;
+    }
+
+    void EventCache::store(const QString& filterHash, const EventList& events) const {
+        if ( fPath.isEmpty() || !fCursors.contains(filterHash) ) {
+            return;
+        }
+
+        // write to a temporary and swap so a crash never leaves a half written cache
+        QSaveFile file(fileName(filterHash));
+        if ( !file.open(QIODevice::WriteOnly) ) {
+            EtherLog::logMsg("Unable to write event cache: " + file.fileName(), LS_Error);
+            return;
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_6);
+        stream << EVENT_CACHE_MAGIC << EVENT_CACHE_VERSION << fCursors.value(filterHash) << (quint32)events.size();
+        foreach ( const EventInfo& info, events ) {
+            info.write(stream);
+        }
+
+        if ( !file.commit() ) {
+            EtherLog::logMsg("Unable to write event cache: " + file.fileName(), LS_Error);
+        }
+    }
+
+    void EventCache::clear() {
+        fCursors.clear();
+        if ( fPath.isEmpty() ) {
+            return;
+        }
+
+        QDir dir(fPath);
+        foreach ( const QString& name, dir.entryList(QStringList("*.dat"), QDir::Files) ) {
+            dir.remove(name);
+        }
+    }
+
+    const QString EventCache::fileName(const QString& filterHash) const {
+        return QDir(fPath).filePath(filterHash + ".dat");
+    }
+
+    EventSpill::EventSpill() : fFile(), fEntries(), fLiveBytes(0)
+    {
+    }
+
+    bool EventSpill::isEmpty() const {
+        return fEntries.isEmpty();
+    }
+
+    void EventSpill::push(const EventList& events) {
+        if ( events.isEmpty() ) {
+            return;
+        }
+
+        if ( !fFile.isOpen() && !fFile.open() ) {
+            EtherLog::logMsg("Unable to open event spill file, dropping " + QString::number(events.size()) + " events", LS_Error);
+            return;
+        }
+
+        fFile.seek(fFile.size());
+        QDataStream stream(&fFile);
+        stream.setVersion(QDataStream::Qt_5_6);
+        foreach ( const EventInfo& info, events ) {
+            const qint64 offset = fFile.pos();
+            info.write(stream);
+            if ( stream.status() != QDataStream::Ok ) {
+                EtherLog::logMsg("Unable to write event spill file, dropping events", LS_Error);
+                fFile.resize(offset);
+                return;
+            }
+
+            const Entry entry = { info.blockNumber(), offset, fFile.pos() - offset };
+            fLiveBytes += entry.fSize;
+
+            const auto it = std::upper_bound(fEntries.begin(), fEntries.end(), entry, [](const Entry& a, const Entry& b) {
+                return a.fBlockNumber > b.fBlockNumber;
+            });
+            fEntries.insert(it, entry);
+        }
+    }
+
+    const EventList EventSpill::takeNewest(int count) {
+        EventList result;
+        QDataStream stream(&fFile);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        count = qMin(count, fEntries.size());
+        for ( int i = 0; i < count; i++ ) {
+            fLiveBytes -= fEntries.at(i).fSize;
+            fFile.seek(fEntries.at(i).fOffset);
+            const EventInfo info(stream);
+            if ( stream.status() != QDataStream::Ok ) {
+                EtherLog::logMsg("Corrupt event in spill file, skipping", LS_Error);
+                stream.resetStatus();
+                continue;
+            }
+            result.append(info);
+        }
+        fEntries.remove(0, count);
+        reclaim();
+
+        return result;
+    }
+
+    const EventList EventSpill::all() {
+        EventList result;
+        QDataStream stream(&fFile);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        foreach ( const Entry& entry, fEntries ) {
+            fFile.seek(entry.fOffset);
+            const EventInfo info(stream);
+            if ( stream.status() != QDataStream::Ok ) {
+                EtherLog::logMsg("Corrupt event in spill file, skipping", LS_Error);
+                stream.resetStatus();
+                continue;
+            }
+            result.append(info);
+        }
+
+        return result;
+    }
+
+    void EventSpill::clear() {
+        fEntries.clear();
+        fLiveBytes = 0;
+        if ( fFile.isOpen() ) {
+            fFile.resize(0);
+        }
+    }
+
+    void EventSpill::reclaim() {
+        if ( fEntries.isEmpty() ) { // everything came back
+            fLiveBytes = 0;
+            fFile.resize(0);
+            return;
+        }
+
+        // cut off whatever was taken from the tail
+        qint64 end = 0;
+        foreach ( const Entry& entry, fEntries ) {
+            end = qMax(end, entry.fOffset + entry.fSize);
+        }
+        if ( end < fFile.size() ) {
+            fFile.resize(end);
+        }
+
+        // holes in the middle, rewrite once they outweigh the live entries
+        if ( end - fLiveBytes > fLiveBytes ) {
+            compact();
+        }
+    }
+
+    void EventSpill::compact() {
+        // move live entries down in file order, a write never overtakes the next read
+        QVector<int> order(fEntries.size());
+        for ( int i = 0; i < order.size(); i++ ) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return fEntries.at(a).fOffset < fEntries.at(b).fOffset;
+        });
+
+        qint64 pos = 0;
+        foreach ( int i, order ) {
+            Entry& entry = fEntries[i];
+            if ( entry.fOffset != pos ) {
+                fFile.seek(entry.fOffset);
+                const QByteArray bytes = fFile.read(entry.fSize);
+                fFile.seek(pos);
+                if ( bytes.size() != entry.fSize || fFile.write(bytes) != entry.fSize ) {
+                    EtherLog::logMsg("Unable to compact event spill file", LS_Error);
+                    return;
+                }
+                entry.fOffset = pos;
+            }
+            pos += entry.fSize;
+        }
+
+        fFile.resize(pos);
+    }
+
+}
@@ -0,0 +1,62 @@
+#ifndef EVENTCACHE_H
+#define EVENTCACHE_H
+
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <QTemporaryFile>
+#include "contractinfo.h"
+
+namespace Etherwall {
+
+    // on-disk store of filter logs keyed by filter hash, each file also keeps the
+    // last block the filter was scanned up to so we only fetch the delta on startup
+    class EventCache
+    {
+    public:
+        EventCache();
+
+        void setNetwork(const QString& networkPostfix);
+        bool hasCursor(const QString& filterHash) const;
+        quint64 cursor(const QString& filterHash) const;
+        void setCursor(const QString& filterHash, quint64 block);
+        void resetCursor(const QString& filterHash);
+        const EventList load(const QString& filterHash);
+        void store(const QString& filterHash, const EventList& events) const;
+        void clear();
+    private:
+        QString fPath;
+        QMap<QString, quint64> fCursors; // filter hash -> last block whose logs made it into the event model
+
+        const QString fileName(const QString& filterHash) const;
+    };
+
+    // session scoped overflow for events evicted from the event model, newest come back first
+    class EventSpill
+    {
+    public:
+        EventSpill();
+
+        bool isEmpty() const;
+        void push(const EventList& events);
+        const EventList takeNewest(int count);
+        const EventList all();
+        void clear();
+    private:
+        struct Entry {
+            quint64 fBlockNumber;
+            qint64 fOffset;
+            qint64 fSize;
+        };
+
+        QTemporaryFile fFile;
+        QVector<Entry> fEntries; // sorted by block number descending
+        qint64 fLiveBytes; // taken entries leave dead bytes behind until the file is trimmed
+
+        void reclaim();
+        void compact();
+    };
+
+}
+
+#endif // EVENTCACHE_H
@@ -1,12 +1,32 @@
 #include "eventmodel.h"
+#include "rpcmetrics.h"
+#include <QSettings>
+#include <algorithm>
 
 namespace Etherwall {
 
-    EventModel::EventModel(const ContractModel& contractModel, const FilterModel& filterModel) :
-        QAbstractTableModel(0), fContractModel(contractModel), fList()
+    const int EVENT_PAGE_SIZE = 200; // spilled events brought back per fetchMore
+
+    EventModel::EventModel(const ContractModel& contractModel, const FilterModel& filterModel, EventCache& cache) :
+        QAbstractTableModel(0), fContractModel(contractModel), fFilterModel(filterModel), fCache(cache), fList(), fStoreTimer(),
+        fSpill(), fMaxCount(0), fMaxAge(0), fMaxMemory(0), fMemory(0), fPagingFull(false), fDecoded(32)
     {
+        loadRetention();
+
+        // persist in the background after a burst of events settles down
+        fStoreTimer.setSingleShot(true);
+        fStoreTimer.setInterval(5000);
+        connect(&fStoreTimer, &QTimer::timeout, this, &EventModel::storeCache);
+
         connect(&contractModel, &ContractModel::newEvent, this, &EventModel::onNewEvent);
+        connect(&contractModel, &ContractModel::newEvents, this, &EventModel::onNewEvents);
         connect(&filterModel, &FilterModel::beforeLoadLogs, this, &EventModel::onBeforeLoadLogs);
+        connect(&filterModel, &FilterModel::cachedLogs, this, &EventModel::onCachedLogs);
+    }
+
+    EventModel::~EventModel()
+    {
+        storeCache();
     }
 
     QHash<int, QByteArray> EventModel::roleNames() const {
@@ -51,6 +71,37 @@ namespace Etherwall {
         return fList.at(row).value(role);
     }
 
+    bool EventModel::canFetchMore(const QModelIndex &parent) const {
+        Q_UNUSED(parent);
+
+        return !fSpill.isEmpty() && !fPagingFull;
+    }
+
+    void EventModel::fetchMore(const QModelIndex &parent) {
+        Q_UNUSED(parent);
+
+        // user scrolled past the retained events, page older ones back in from disk.
+        // Spilled events are stored raw, decode them like the cached ones
+        EventList page = fContractModel.processEvents(fSpill.takeNewest(EVENT_PAGE_SIZE));
+
+        // only what fits the memory limit, the rest goes back for later
+        qint64 memory = fMemory;
+        int fit = 0;
+        while ( fit < page.size() && (fMaxMemory <= 0 || memory + page.at(fit).memorySize() <= fMaxMemory) ) {
+            memory += page.at(fit).memorySize();
+            fit++;
+        }
+
+        if ( fit < page.size() ) {
+            fSpill.push(page.mid(fit));
+            page.erase(page.begin() + fit, page.end());
+            fPagingFull = true;
+        }
+
+        insertEvents(page);
+        enforceRetention(true);
+    }
+
     const QString EventModel::getName(int index) const {
         if ( index < 0 || index >= fList.length() ) {
             return QString();
@@ -121,7 +172,7 @@ namespace Etherwall {
         }
 
         const ContractArgs args = fList.at(index).getArguments();
-        const QVariantList params = fList.at(index).getParams();
+        const QVariantList params = decodedParams(fList.at(index));
         QVariantList result;
         QVariantMap map;
 
@@ -137,37 +188,187 @@ namespace Etherwall {
         return result;
     }
 
-    const QString EventModel::getParamValue(int index) const {
+    const QString EventModel::getParamValue(int index, int paramIndex) const {
         if ( index < 0 || index >= fList.length() ) {
             return QString();
         }
 
-        const QVariant value = fList.at(index).getParams().at(index);
-        QString strVal = fList.at(index).paramToStr(value);
+        const QVariantList params = decodedParams(fList.at(index));
+        if ( paramIndex < 0 || paramIndex >= params.size() ) {
+            return QString();
+        }
+
+        QString strVal = fList.at(index).paramToStr(params.at(paramIndex));
 
         return strVal;
     }
 
-    void EventModel::onNewEvent(const EventInfo& info, bool isNew) {
-        // sort by block number descending
-        int index = 0;
-        while ( index < fList.length() && fList.at(index).blockNumber() > info.blockNumber() ) {
-            index++;
+    const QVariantList EventModel::decodedParams(const EventInfo& info) const {
+        const QString key = info.transactionHash() + ":" + QString::number(info.logIndex());
+        const QVariantList* cached = fDecoded.object(key);
+        if ( cached != NULL ) {
+            return *cached;
         }
 
-        beginInsertRows(QModelIndex(), index, index);
-        fList.insert(index, info);
-        endInsertRows();
+        const QVariantList params = info.getParams();
+        fDecoded.insert(key, new QVariantList(params));
+
+        return params;
+    }
+
+    void EventModel::onNewEvent(const EventInfo& info, bool isNew) {
+        insertEvent(info);
+        enforceRetention();
+        fStoreTimer.start();
 
         if ( isNew ) {
-            emit receivedEvent(info.contract(), info.signature());
+            emit receivedEvent(info.contract(), info.signature(decodedParams(info)));
         }
     }
 
+    void EventModel::onNewEvents(const EventList& events) {
+        RpcMetrics::Span span("EventModel::onNewEvents");
+        insertEvents(events);
+        enforceRetention();
+
+        fStoreTimer.start();
+    }
+
     void EventModel::onBeforeLoadLogs() {
         beginResetModel();
         fList.clear();
+        fSpill.clear();
+        fDecoded.clear();
+        fMemory = 0;
+        fPagingFull = false;
+        loadRetention();
         endResetModel();
     }
 
+    void EventModel::onCachedLogs(const EventList& events) {
+        // cached events are stored raw, decode them against the current contracts
+        insertEvents(fContractModel.processEvents(events));
+        enforceRetention();
+    }
+
+    void EventModel::storeCache() {
+        fStoreTimer.stop();
+        const EventList spilled = fSpill.all();
+
+        foreach ( const FilterInfo& filter, fFilterModel.getFilters() ) {
+            const QString hash = filter.getHash();
+            if ( !filter.getActive() || !fCache.hasCursor(hash) ) {
+                continue;
+            }
+
+            EventList events;
+            foreach ( const EventInfo& info, fList ) {
+                if ( filter.matches(info) ) {
+                    events.append(info);
+                }
+            }
+
+            foreach ( const EventInfo& info, spilled ) {
+                if ( filter.matches(info) ) {
+                    events.append(info);
+                }
+            }
+
+            fCache.store(hash, events);
+        }
+    }
+
+    // sort by block number descending, newer events of the same block go after existing ones
+    static bool newerBlock(const EventInfo& a, const EventInfo& b) {
+        return a.blockNumber() > b.blockNumber();
+    }
+
+    void EventModel::insertEvent(const EventInfo& info) {
+        const int index = std::upper_bound(fList.begin(), fList.end(), info, newerBlock) - fList.begin();
+
+        beginInsertRows(QModelIndex(), index, index);
+        fList.insert(index, info);
+        fMemory += info.memorySize();
+        endInsertRows();
+    }
+
+    void EventModel::insertEvents(const EventList& events) {
+        RpcMetrics::Span span("EventModel::insertEvents");
+        if ( events.isEmpty() ) {
+            return;
+        }
+
+        EventList sorted = events;
+        std::stable_sort(sorted.begin(), sorted.end(), newerBlock);
+
+        // merge in runs, each run of new events landing between the same two rows is one insert
+        int index = 0;
+        int i = 0;
+        while ( i < sorted.size() ) {
+            index = std::upper_bound(fList.begin() + index, fList.end(), sorted.at(i), newerBlock) - fList.begin();
+            int end = i + 1;
+            while ( end < sorted.size() && (index == fList.size() || fList.at(index).blockNumber() < sorted.at(end).blockNumber()) ) {
+                end++;
+            }
+
+            beginInsertRows(QModelIndex(), index, index + end - i - 1);
+            for ( int j = i; j < end; j++ ) {
+                fList.insert(index++, sorted.at(j));
+                fMemory += sorted.at(j).memorySize();
+            }
+            endInsertRows();
+
+            i = end;
+        }
+    }
+
+    void EventModel::loadRetention() {
+        const QSettings settings;
+        fMaxCount = settings.value("events/maxcount", 10000).toInt();
+        fMaxAge = settings.value("events/maxage", 0).toULongLong(); // in blocks from the newest event
+        fMaxMemory = settings.value("events/maxmemory", 64).toLongLong() * 1024 * 1024; // in MB
+    }
+
+    void EventModel::enforceRetention(bool paging) {
+        if ( fList.isEmpty() ) {
+            return;
+        }
+
+        // events paged back in on scroll stay past the count limit, memory and age still apply
+        const int maxCount = paging ? 0 : fMaxCount;
+
+        // oldest events are at the end, trim from there
+        const quint64 newest = fList.first().blockNumber();
+        EventList evicted;
+        qint64 memory = fMemory;
+        int keep = fList.size();
+        while ( keep > 0 ) {
+            const EventInfo& oldest = fList.at(keep - 1);
+            const bool tooOld = fMaxAge > 0 && newest - oldest.blockNumber() > fMaxAge;
+            const bool tooMany = maxCount > 0 && keep > maxCount;
+            const bool tooBig = fMaxMemory > 0 && memory > fMaxMemory;
+            if ( !tooOld && !tooMany && !tooBig ) {
+                break;
+            }
+
+            if ( !tooOld ) { // aged out events are gone for good, the rest can be paged back
+                evicted.prepend(oldest);
+            }
+            memory -= oldest.memorySize();
+            keep--;
+        }
+
+        if ( keep == fList.size() ) {
+            return;
+        }
+
+        beginRemoveRows(QModelIndex(), keep, fList.size() - 1);
+        fList.erase(fList.begin() + keep, fList.end());
+        fMemory = memory;
+        endRemoveRows();
+
+        fSpill.push(evicted);
+        fPagingFull = false;
+    }
+
 }
@@ -3,9 +3,12 @@
 
 #include <QObject>
 #include <QAbstractTableModel>
+#include <QTimer>
+#include <QCache>
 #include "contractinfo.h"
 #include "contractmodel.h"
 #include "filtermodel.h"
+#include "eventcache.h"
 
 namespace Etherwall {
 
@@ -13,12 +16,15 @@ namespace Etherwall {
     {
         Q_OBJECT
     public:
-        EventModel(const ContractModel& contractModel, const FilterModel& filterModel);
+        EventModel(const ContractModel& contractModel, const FilterModel& filterModel, EventCache& cache);
+        virtual ~EventModel();
 
         QHash<int, QByteArray> roleNames() const;
         int rowCount(const QModelIndex & parent __attribute__ ((unused))) const;
         Q_INVOKABLE virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
         QVariant data(const QModelIndex & index, int role) const;
+        bool canFetchMore(const QModelIndex &parent) const;
+        void fetchMore(const QModelIndex &parent);
         Q_INVOKABLE const QString getName(int index) const;
         Q_INVOKABLE const QString getContract(int index) const;
         Q_INVOKABLE const QString getAddress(int index) const;
@@ -28,15 +34,36 @@ namespace Etherwall {
         Q_INVOKABLE const QString getTransactionHash(int index) const;
         Q_INVOKABLE const QString getTopics(int index) const;
         Q_INVOKABLE const QVariantList getArgModel(int index) const;
-        Q_INVOKABLE const QString getParamValue(int index) const;
+        Q_INVOKABLE const QString getParamValue(int index, int paramIndex) const;
     public slots:
         void onNewEvent(const EventInfo& info, bool isNew);
+        void onNewEvents(const EventList& events);
         void onBeforeLoadLogs();
+        void onCachedLogs(const EventList& events);
+    private slots:
+        void storeCache();
     signals:
         void receivedEvent(const QString& contract, const QString& signature);
     private:
         const ContractModel& fContractModel;
+        const FilterModel& fFilterModel;
+        EventCache& fCache;
         EventList fList;
+        QTimer fStoreTimer;
+        EventSpill fSpill;
+        int fMaxCount;
+        quint64 fMaxAge;
+        qint64 fMaxMemory;
+        qint64 fMemory;
+        bool fPagingFull; // paged back up to the memory limit, no more until something is evicted
+        mutable QCache<QString, QVariantList> fDecoded; // recently viewed event params
+
+        const QVariantList decodedParams(const EventInfo& info) const;
+
+        void insertEvent(const EventInfo& info);
+        void insertEvents(const EventList& events);
+        void loadRetention();
+        void enforceRetention(bool paging = false);
     };
 
 }
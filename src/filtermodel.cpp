@@ -1,10 +1,14 @@
 #include "filtermodel.h"
 #include "helpers.h"
+#include "rpcmetrics.h"
+#include "settingsstore.h"
 #include <QSettings>
 
 namespace Etherwall {
 
-    FilterModel::FilterModel(NodeIPC& ipc) : QAbstractTableModel(0), fIpc(ipc), fList()
+    const quint64 LOG_REORG_DEPTH = 12; // cached logs this close to the head get refetched
+
+    FilterModel::FilterModel(NodeIPC& ipc, EventCache& cache) : QAbstractTableModel(0), fIpc(ipc), fCache(cache), fList(), fFetches()
     {
     }
 
@@ -79,6 +83,10 @@ namespace Etherwall {
         return fList.at(index).value(FilterActiveRole).toBool();
     }
 
+    const EventFilters& FilterModel::getFilters() const {
+        return fList;
+    }
+
     void FilterModel::addFilter(const QString& name, const QString& address, const QString& contract, const QString& topics, bool active) {
         QJsonParseError parseError;
         QJsonDocument doc = QJsonDocument::fromJson(topics.toUtf8(), &parseError);
@@ -90,10 +98,7 @@ namespace Etherwall {
 
         const QJsonArray topicArray = doc.array();
         const FilterInfo info(name, address, contract, topicArray, active);
-        QSettings settings;
-        settings.beginGroup("filters" + fIpc.chainManager().networkPostfix());
-        settings.setValue(info.getHandle(), info.toJsonString());
-        settings.endGroup();
+        SettingsStore::setValue("filters" + fIpc.chainManager().networkPostfix() + "/" + info.getHandle(), info.toJsonString());
 
         // check if it's an update
         for ( int i = 0; i < fList.length(); i++ ) {
@@ -101,7 +106,7 @@ namespace Etherwall {
             if ( fi.getHandle() == info.getHandle() ) {
                 fList[i] = info;
 
-                update(i);
+                update(i, fi.getHash() != info.getHash());
                 return;
             }
         }
@@ -111,7 +116,9 @@ namespace Etherwall {
         endInsertRows();
 
         registerFilters();
-        loadLogs();
+        if ( info.getActive() ) {
+            loadFilterLogs(info);
+        }
     }
 
     void FilterModel::setFilterActive(int index, bool active) {
@@ -121,11 +128,11 @@ namespace Etherwall {
 
         fList[index].setActive(active);
         const FilterInfo info = fList.at(index);
+        if ( !active ) { // events stay in the list, resume from here when re-activated
+            fCache.setCursor(info.getHash(), fIpc.blockNumber());
+        }
 
-        QSettings settings;
-        settings.beginGroup("filters" + fIpc.chainManager().networkPostfix());
-        settings.setValue(info.getHandle(), info.toJsonString());
-        settings.endGroup();
+        SettingsStore::setValue("filters" + fIpc.chainManager().networkPostfix() + "/" + info.getHandle(), info.toJsonString());
 
         update(index);
     }
@@ -137,17 +144,14 @@ namespace Etherwall {
 
         const FilterInfo info = fList.at(index);
         registerFilters();
-        QSettings settings;
-        settings.beginGroup("filters" + fIpc.chainManager().networkPostfix());
-        settings.remove(info.getHandle());
-        settings.endGroup();
+        SettingsStore::remove("filters" + fIpc.chainManager().networkPostfix() + "/" + info.getHandle());
 
         beginRemoveRows(QModelIndex(), index, index);
         fList.removeAt(index);
         endRemoveRows();
     }
 
-    void FilterModel::update(int index) {
+    void FilterModel::update(int index, bool definitionChanged) {
         const QModelIndex& leftIndex = QAbstractTableModel::createIndex(index, 0);
         const QModelIndex& rightIndex = QAbstractTableModel::createIndex(index, 3);
         QVector<int> roles(5);
@@ -160,7 +164,11 @@ namespace Etherwall {
 
         registerFilters();
         if ( fList.at(index).getActive() ) {
-            loadLogs();
+            if ( definitionChanged ) { // old results no longer match, start over
+                loadLogs();
+            } else {
+                loadFilterLogs(fList.at(index));
+            }
         }
     }
 
@@ -197,9 +205,7 @@ namespace Etherwall {
     }
 
     void FilterModel::loadLogs() const {
-        const QSettings settings;
-        quint64 day = settings.value("geth/logsize", 7200).toLongLong();
-        quint64 fromBlock = fIpc.blockNumber() > day ? fIpc.blockNumber() - day : 1;
+        fCache.clear();
 
         emit beforeLoadLogs();
         foreach ( const FilterInfo& info, fList ) {
@@ -207,24 +213,114 @@ namespace Etherwall {
                 continue;
             }
 
-            QStringList addresses;
-            addresses.append(info.value(FilterAddressRole).toString());
-            const QJsonArray infoTopics = info.value(FilterTopicsRole).toJsonArray();
-            info.getHandle();
-            fIpc.loadLogs(addresses, infoTopics, fromBlock, "watchFilter");
+            loadFilterLogs(info);
+        }
+    }
+
+    void FilterModel::loadFilterLogs(const FilterInfo& info) const {
+        const quint64 blockNumber = fIpc.blockNumber();
+        quint64 fromBlock = logWindowStart();
+
+        // resume from where we left off for this filter if it's still within the window
+        const QString hash = info.getHash();
+        quint64 scanned = 0;
+        if ( lastScanned(hash, scanned) && scanned >= fromBlock ) {
+            fromBlock = scanned + 1;
+            if ( blockNumber > 0 && fromBlock > blockNumber ) {
+                return; // nothing new since last time
+            }
+        }
+
+        QStringList addresses;
+        addresses.append(info.value(FilterAddressRole).toString());
+        const QJsonArray infoTopics = info.value(FilterTopicsRole).toJsonArray();
+        fIpc.loadLogs(addresses, infoTopics, fromBlock, "watchFilter");
+        // the cursor only moves once the reply's events are in the event model, see onLogsFetched
+        fFetches.enqueue(qMakePair(hash, blockNumber));
+    }
+
+    void FilterModel::onLogsFetched(bool ok) {
+        if ( fFetches.isEmpty() ) {
+            return; // in flight before a bail, already given up on
+        }
+
+        // the node answers in order, so this is the oldest getLogs we sent
+        const QPair<QString, quint64> fetch = fFetches.dequeue();
+        if ( ok && (!fCache.hasCursor(fetch.first) || fCache.cursor(fetch.first) < fetch.second) ) {
+            fCache.setCursor(fetch.first, fetch.second);
+        }
+    }
+
+    void FilterModel::onLogsLost() {
+        // better to fetch some blocks twice than to skip them
+        fFetches.clear();
+    }
+
+    bool FilterModel::lastScanned(const QString& hash, quint64& block) const {
+        // a getLogs in flight counts as scanned, asking for the same blocks again would duplicate events
+        for ( int i = fFetches.size() - 1; i >= 0; i-- ) {
+            if ( fFetches.at(i).first == hash ) {
+                block = fFetches.at(i).second;
+                return true;
+            }
+        }
+
+        if ( fCache.hasCursor(hash) ) {
+            block = fCache.cursor(hash);
+            return true;
+        }
+
+        return false;
+    }
+
+    void FilterModel::restoreLogs() const {
+        RpcMetrics::Span span("FilterModel::restoreLogs");
+        fCache.setNetwork(fIpc.chainManager().networkPostfix());
+        const quint64 windowStart = logWindowStart();
+
+        emit beforeLoadLogs();
+        foreach ( const FilterInfo& info, fList ) {
+            if ( !info.getActive() ) {
+                continue;
+            }
+
+            const QString hash = info.getHash();
+            const EventList cached = fCache.load(hash);
+            if ( fCache.hasCursor(hash) && fCache.cursor(hash) >= windowStart + LOG_REORG_DEPTH ) {
+                // drop the most recent blocks and fetch them again in case they got reorged out
+                const quint64 cursor = fCache.cursor(hash) - LOG_REORG_DEPTH;
+                EventList restored;
+                foreach ( const EventInfo& event, cached ) {
+                    if ( event.blockNumber() >= windowStart && event.blockNumber() <= cursor ) {
+                        restored.append(event);
+                    }
+                }
+
+                fCache.setCursor(hash, cursor);
+                emit cachedLogs(restored);
+            } else { // too old to be of use, start over
+                fCache.resetCursor(hash);
+            }
+
+            loadFilterLogs(info);
         }
     }
 
+    quint64 FilterModel::logWindowStart() const {
+        const QSettings settings;
+        quint64 day = settings.value("geth/logsize", 7200).toLongLong();
+
+        return fIpc.blockNumber() > day ? fIpc.blockNumber() - day : 1;
+    }
+
     void FilterModel::reload() {
         beginResetModel();
-        QSettings settings;
-        settings.beginGroup("filters" + fIpc.chainManager().networkPostfix());
-
-        const QStringList list = settings.allKeys();
+        const QString group = "filters" + fIpc.chainManager().networkPostfix();
+        const QStringList list = SettingsStore::keys(group);
 
         foreach ( const QString addr, list ) {
             QJsonParseError parseError;
-            const QString val = settings.value(addr).toString();
+            const QString val = SettingsStore::value(group + "/" + addr).toString();
             const QJsonDocument jsonDoc = QJsonDocument::fromJson(val.toUtf8(), &parseError);
 
             if ( parseError.error != QJsonParseError::NoError ) {
@@ -235,10 +331,8 @@ namespace Etherwall {
             }
         }
 
-        settings.endGroup();
-
         registerFilters();
-        loadLogs();
+        restoreLogs();
         endResetModel();
     }
 
@@ -3,8 +3,11 @@
 
 #include <QObject>
 #include <QAbstractListModel>
+#include <QQueue>
+#include <QPair>
 #include "contractinfo.h"
 #include "nodeipc.h"
+#include "eventcache.h"
 
 namespace Etherwall {
 
@@ -12,7 +15,7 @@ namespace Etherwall {
     {
         Q_OBJECT
     public:
-        FilterModel(NodeIPC& ipc);
+        FilterModel(NodeIPC& ipc, EventCache& cache);
 
         QHash<int, QByteArray> roleNames() const;
         int rowCount(const QModelIndex & parent = QModelIndex()) const;
@@ -23,6 +26,7 @@ namespace Etherwall {
         Q_INVOKABLE const QString getContract(int index) const;
         Q_INVOKABLE const QJsonArray getTopics(int index) const;
         Q_INVOKABLE bool getActive(int index) const;
+        const EventFilters& getFilters() const;
 
         Q_INVOKABLE void addFilter(const QString& name, const QString& address, const QString& contract, const QString& topics, bool active);
         Q_INVOKABLE void setFilterActive(int index, bool active);
@@ -30,13 +34,22 @@ namespace Etherwall {
         Q_INVOKABLE void loadLogs() const;
     public slots:
         void reload();
+        void onLogsFetched(bool ok);
+        void onLogsLost();
     signals:
         void beforeLoadLogs() const;
+        void cachedLogs(const EventList& events) const;
     private:
-        void update(int index);
+        void update(int index, bool definitionChanged = false);
         void registerFilters() const;
+        void loadFilterLogs(const FilterInfo& info) const;
+        void restoreLogs() const;
+        quint64 logWindowStart() const;
+        bool lastScanned(const QString& hash, quint64& block) const;
         NodeIPC& fIpc;
+        EventCache& fCache;
         EventFilters fList;
+        mutable QQueue<QPair<QString, quint64> > fFetches; // getLogs in flight by filter hash and block they go up to
 
         int getActiveCount() const;
     };
@@ -1,17 +1,131 @@
 #include "gethlogapp.h"
 #include <QApplication>
 #include <QClipboard>
+#include <QScreen>
 
 namespace Etherwall {
 
-    GethLogApp::GethLogApp() : GethLog()
+    const int GETH_LOG_REFRESH_MIN = 16; // ms, never faster than a 60Hz frame
+    const int GETH_LOG_REFRESH_MAX = 100; // ms, for screens reporting odd rates
+    const int GETH_LOG_PARTIAL_WAIT = 250; // ms a line without its newline waits for the rest
+
+    GethLogApp::GethLogApp() : GethLog(),
+        fRing("diagnostics/gethLogFile", refreshInterval()), fMsgRole(-1), fPartial(), fPartialTimer(),
+        fTrimQueued(false), fTrimmable(true)
     {
+        fMsgRole = roleNames().key("msg", -1);
+        fRing.setLevel(LS_Debug); // the geth tab shows everything
+
+        // e.g. our own appended notes have no newline, they shouldn't wait for the next chunk forever
+        fPartialTimer.setSingleShot(true);
+        fPartialTimer.setInterval(GETH_LOG_PARTIAL_WAIT);
+        connect(&fPartialTimer, &QTimer::timeout, this, &GethLogApp::flushPartial);
 
+        // geth output arrives as chunks of whatever the process wrote, the ring gets it line by line
+        connect(this, &QAbstractItemModel::rowsInserted, this, &GethLogApp::onRowsInserted, Qt::DirectConnection);
     }
 
     void GethLogApp::saveToClipboard() const
     {
-         QApplication::clipboard()->setText(getContents());
+        QString result;
+        foreach ( const LogRing::Entry& entry, fRing.entries(LS_Debug) ) {
+            result += entry.fMessage + "\n";
+        }
+
+        QApplication::clipboard()->setText(result);
+    }
+
+    LogRing& GethLogApp::ring()
+    {
+        return fRing;
+    }
+
+    void GethLogApp::onRowsInserted(const QModelIndex& parent, int first, int last)
+    {
+        for ( int row = first; row <= last; row++ ) {
+            ingest(data(index(row, 0, parent), fMsgRole).toString());
+        }
+
+        // not from in here, the base model may still be working on its rows after the insert
+        if ( fTrimmable && !fTrimQueued ) {
+            fTrimQueued = true;
+            QMetaObject::invokeMethod(this, &GethLogApp::trim, Qt::QueuedConnection);
+        }
+    }
+
+    void GethLogApp::flushPartial()
+    {
+        fPartialTimer.stop();
+        if ( !fPartial.isEmpty() ) {
+            const QString line = fPartial;
+            fPartial.clear();
+            fRing.append(toSeverity(QStringRef(&line)), line);
+        }
+    }
+
+    void GethLogApp::trim()
+    {
+        // every chunk the base model holds went to the ring already, no need for a second copy
+        fTrimQueued = false;
+        if ( rowCount() > 0 && !removeRows(0, rowCount()) ) {
+            fTrimmable = false;
+            fRing.append(LS_Warning, "Geth log model doesn't support removing rows, it keeps its own copy");
+        }
+    }
+
+    void GethLogApp::ingest(const QString& text)
+    {
+        // a chunk ends wherever the process' write did, lines can span two of them
+        fPartialTimer.stop();
+        const QString chunk = fPartial.isEmpty() ? text : fPartial + text;
+        fPartial.clear();
+
+        // indexOf on a single QChar is vectorized, no per character work on our side
+        int start = 0;
+        while ( start < chunk.size() ) {
+            int end = chunk.indexOf(QLatin1Char('\n'), start);
+            if ( end < 0 ) {
+                fPartial = chunk.mid(start);
+                fPartialTimer.start();
+                return;
+            }
+
+            int length = end - start;
+            if ( length > 0 && chunk.at(end - 1) == QLatin1Char('\r') ) {
+                length--;
+            }
+
+            if ( length > 0 ) {
+                const QStringRef line = chunk.midRef(start, length);
+                fRing.append(toSeverity(line), line.toString());
+            }
+            start = end + 1;
+        }
+    }
+
+    int GethLogApp::toSeverity(const QStringRef& line)
+    {
+        // geth prefixes each line with its level, e.g. "WARN [10-19|12:00:00.000] ..."
+        if ( line.startsWith(QLatin1String("WARN")) ) {
+            return LS_Warning;
+        } else if ( line.startsWith(QLatin1String("ERROR")) || line.startsWith(QLatin1String("CRIT")) ) {
+            return LS_Error;
+        } else if ( line.startsWith(QLatin1String("DEBUG")) || line.startsWith(QLatin1String("TRACE")) ) {
+            return LS_Debug;
+        }
+
+        return LS_Info;
+    }
+
+    int GethLogApp::refreshInterval()
+    {
+        // push new lines to the view about once per display frame, not once per line
+        const QScreen* screen = QGuiApplication::primaryScreen();
+        if ( screen == nullptr || screen->refreshRate() <= 0.0 ) {
+            return GETH_LOG_REFRESH_MIN * 2;
+        }
+
+        return qBound(GETH_LOG_REFRESH_MIN, qRound(1000.0 / screen->refreshRate()), GETH_LOG_REFRESH_MAX);
     }
 
 }
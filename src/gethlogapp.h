@@ -1,7 +1,9 @@
 #ifndef GETHLOGAPP_H
 #define GETHLOGAPP_H
 
+#include <QTimer>
 #include "gethlog.h"
+#include "logring.h"
 
 namespace Etherwall {
 
@@ -12,6 +14,22 @@ namespace Etherwall {
         GethLogApp();
 
         Q_INVOKABLE void saveToClipboard() const;
+        LogRing& ring();
+    private slots:
+        void onRowsInserted(const QModelIndex& parent, int first, int last);
+        void flushPartial();
+        void trim();
+    private:
+        LogRing fRing;
+        int fMsgRole;
+        QString fPartial; // trailing line of the last chunk, waiting on the rest of it
+        QTimer fPartialTimer;
+        bool fTrimQueued;
+        bool fTrimmable; // cleared if the base model won't give up its rows
+
+        void ingest(const QString& text);
+        static int toSeverity(const QStringRef& line);
+        static int refreshInterval();
     };
 }
 
@@ -1,5 +1,5 @@
 #include "initializer.h"
-#include "etherlog.h"
+#include "etherlogapp.h"
 #include "helpers.h"
 #include "nodeipc.h"
 #include <QJsonDocument>
@@ -59,7 +59,7 @@ namespace Etherwall {
         QJsonObject objectJson;
         const QByteArray data = QJsonDocument(objectJson).toJson();
 
-        EtherLog::logMsg("HTTP Post request: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post request: " + data; });
         EtherLog::logMsg("Connecting to main Etherwall server", LS_Info);
 
         fNetManager.post(request, data);
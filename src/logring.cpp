@@ -0,0 +1,284 @@
+#include "logring.h"
+#include <QSettings>
+#include <QDateTime>
+#include <QTextStream>
+#include <cstring>
+
+namespace Etherwall {
+
+    const int LOG_RING_FLUSH = 1000; // ms between log file appends
+
+    LogRing::Entry::Entry() : fTime(0), fSeverity(LS_Info), fMessage()
+    {
+    }
+
+    LogRing::Slot::Slot() : fSeq(0), fTime(0), fSeverity(0), fLength(0)
+    {
+    }
+
+    LogRing::LogRing(const QString& fileSetting, int refreshInterval) : QAbstractListModel(nullptr),
+        fSlots(new Slot[SIZE]), fLongMutex(), fLong(), fHead(0), fShown(0), fFlushed(0), fLevel(LS_Info), fRows(),
+        fRefreshTimer(), fFlushTimer(), fThread(), fWriter(), fFile()
+    {
+        fRefreshTimer.setInterval(refreshInterval);
+        connect(&fRefreshTimer, &QTimer::timeout, this, &LogRing::refresh);
+        fRefreshTimer.start();
+
+        const QSettings settings;
+        const QString fileName = settings.value(fileSetting).toString();
+        if ( fileName.isEmpty() ) {
+            return;
+        }
+
+        fFile.setFileName(fileName);
+        if ( !fFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text) ) {
+            append(LS_Error, "Unable to open log file " + fileName + ": " + fFile.errorString());
+            return;
+        }
+
+        fFile.moveToThread(&fThread);
+        fWriter.moveToThread(&fThread);
+        fThread.start(QThread::LowPriority);
+        fFlushTimer.setInterval(LOG_RING_FLUSH);
+        connect(&fFlushTimer, &QTimer::timeout, this, &LogRing::flush);
+        fFlushTimer.start();
+    }
+
+    LogRing::~LogRing()
+    {
+        if ( fThread.isRunning() ) {
+            fFlushTimer.stop();
+            const quint64 head = fHead.load(std::memory_order_acquire);
+            QMetaObject::invokeMethod(&fWriter, [this, head]() { write(head); }, Qt::BlockingQueuedConnection);
+            fThread.quit();
+            fThread.wait();
+        }
+    }
+
+    void LogRing::append(int severity, const QString& message)
+    {
+        const QByteArray utf8 = message.toUtf8();
+        const quint64 position = fHead.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = fSlots[(int)(position & (SIZE - 1))];
+        if ( utf8.size() > TEXT_SIZE ) { // before the slot is published, so readers find it
+            QMutexLocker locker(&fLongMutex);
+            QMutableHashIterator<quint64, QString> cut(fLong);
+            while ( cut.hasNext() ) {
+                if ( cut.next().key() + SIZE <= position ) {
+                    cut.remove(); // its slot is overwritten by now
+                }
+            }
+            fLong.insert(position, message);
+        }
+
+        slot.fSeq.store(position * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.fTime = QDateTime::currentMSecsSinceEpoch();
+        slot.fSeverity = severity;
+        slot.fLength = qMin(utf8.size(), (int)TEXT_SIZE);
+        std::memcpy(slot.fText, utf8.constData(), slot.fLength);
+        slot.fSeq.store(position * 2 + 2, std::memory_order_release);
+    }
+
+    const QVector<LogRing::Entry> LogRing::entries(int minSeverity) const
+    {
+        QVector<Entry> result;
+        const quint64 head = fHead.load(std::memory_order_acquire);
+        const quint64 start = oldest(head);
+        result.reserve((int)(head - start));
+
+        for ( quint64 position = start; position < head; position++ ) {
+            Entry entry;
+            if ( read(position, entry) && entry.fSeverity >= minSeverity ) {
+                result.append(entry);
+            }
+        }
+
+        return result;
+    }
+
+    const QString LogRing::render(int minSeverity) const
+    {
+        QString result;
+        QTextStream stream(&result);
+        foreach ( const Entry& entry, entries(minSeverity) ) {
+            stream << formatTime(entry.fTime) << "\t" << severityName(entry.fSeverity) << "\t" << entry.fMessage << "\n";
+        }
+
+        return result;
+    }
+
+    void LogRing::setLevel(int level)
+    {
+        if ( level == fLevel ) {
+            return;
+        }
+
+        // the only time the view is rebuilt from scratch
+        fLevel = level;
+        beginResetModel();
+        fRows.clear();
+        fShown = oldest(fHead.load(std::memory_order_acquire));
+        endResetModel();
+        refresh();
+    }
+
+    QHash<int, QByteArray> LogRing::roleNames() const
+    {
+        QHash<int, QByteArray> roles;
+        roles[DateRole] = "date";
+        roles[SeverityRole] = "severity";
+        roles[MsgRole] = "msg";
+
+        return roles;
+    }
+
+    int LogRing::rowCount(const QModelIndex& parent) const
+    {
+        Q_UNUSED(parent);
+        return fRows.size();
+    }
+
+    QVariant LogRing::data(const QModelIndex& index, int role) const
+    {
+        const int row = index.row();
+        if ( row < 0 || row >= fRows.size() ) {
+            return QVariant();
+        }
+
+        // formatted here so only what the view shows gets formatted
+        const Entry& entry = fRows.at(row);
+        switch ( role ) {
+            case DateRole: return formatTime(entry.fTime);
+            case SeverityRole: return severityName(entry.fSeverity);
+            case MsgRole: return entry.fMessage;
+        }
+
+        return QVariant();
+    }
+
+    void LogRing::refresh()
+    {
+        const quint64 head = fHead.load(std::memory_order_acquire);
+        if ( head == fShown ) {
+            return;
+        }
+
+        QList<Entry> added;
+        quint64 position = qMax(fShown, oldest(head));
+        for ( ; position < head; position++ ) {
+            Entry entry;
+            if ( read(position, entry) ) {
+                if ( entry.fSeverity >= fLevel ) {
+                    added.append(entry);
+                }
+            } else if ( pending(position) ) {
+                break; // not written yet, pick it up next time
+            }
+        }
+        fShown = position;
+
+        if ( !added.isEmpty() ) {
+            beginInsertRows(QModelIndex(), fRows.size(), fRows.size() + added.size() - 1);
+            fRows.append(added);
+            endInsertRows();
+        }
+
+        const int excess = fRows.size() - SIZE;
+        if ( excess > 0 ) {
+            beginRemoveRows(QModelIndex(), 0, excess - 1);
+            fRows.erase(fRows.begin(), fRows.begin() + excess);
+            endRemoveRows();
+        }
+    }
+
+    void LogRing::flush()
+    {
+        const quint64 head = fHead.load(std::memory_order_acquire);
+        QMetaObject::invokeMethod(&fWriter, [this, head]() { write(head); }, Qt::QueuedConnection);
+    }
+
+    bool LogRing::read(quint64 position, Entry& entry) const
+    {
+        const Slot& slot = fSlots[(int)(position & (SIZE - 1))];
+        const quint64 expected = position * 2 + 2;
+        if ( slot.fSeq.load(std::memory_order_acquire) != expected ) {
+            return false; // still being written or already overwritten
+        }
+
+        char text[TEXT_SIZE];
+        const qint64 time = slot.fTime;
+        const int severity = slot.fSeverity;
+        const int length = qBound(0, slot.fLength, (int)TEXT_SIZE);
+        std::memcpy(text, slot.fText, length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( slot.fSeq.load(std::memory_order_relaxed) != expected ) {
+            return false; // overwritten while we copied
+        }
+
+        entry.fTime = time;
+        entry.fSeverity = severity;
+        if ( length == TEXT_SIZE ) {
+            QMutexLocker locker(&fLongMutex);
+            entry.fMessage = fLong.value(position);
+        }
+        if ( entry.fMessage.isEmpty() ) {
+            entry.fMessage = QString::fromUtf8(text, length);
+        }
+        return true;
+    }
+
+    bool LogRing::pending(quint64 position) const
+    {
+        return fSlots[(int)(position & (SIZE - 1))].fSeq.load(std::memory_order_acquire) < position * 2 + 2;
+    }
+
+    quint64 LogRing::oldest(quint64 head) const
+    {
+        return head > (quint64)SIZE ? head - SIZE : 0;
+    }
+
+    void LogRing::write(quint64 head)
+    {
+        if ( head <= fFlushed || !fFile.isOpen() ) {
+            return;
+        }
+
+        QTextStream stream(&fFile);
+        if ( head - fFlushed > (quint64)SIZE ) {
+            stream << "... " << (head - fFlushed - SIZE) << " records dropped\n";
+            fFlushed = head - SIZE;
+        }
+
+        for ( ; fFlushed < head; fFlushed++ ) {
+            Entry entry;
+            if ( read(fFlushed, entry) ) {
+                stream << formatTime(entry.fTime) << "\t" << severityName(entry.fSeverity) << "\t" << entry.fMessage << "\n";
+            } else if ( pending(fFlushed) ) {
+                break; // not written yet, pick it up next time
+            }
+        }
+
+        stream.flush();
+        fFile.flush();
+    }
+
+    const QString LogRing::severityName(int severity)
+    {
+        switch ( severity ) {
+            case LS_Debug: return "Debug";
+            case LS_Info: return "Info";
+            case LS_Warning: return "Warning";
+            case LS_Error: return "Error";
+        }
+
+        return "?";
+    }
+
+    const QString LogRing::formatTime(qint64 time)
+    {
+        return QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss.zzz");
+    }
+
+}
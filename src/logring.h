@@ -0,0 +1,92 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QTimer>
+#include <QThread>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QScopedArrayPointer>
+#include <atomic>
+#include "etherlog.h"
+
+namespace Etherwall {
+
+    // bounded in-memory log of the most recent records. Writers from any thread claim a slot
+    // with one atomic add and never wait, readers copy slots seqlock style and skip the ones
+    // overwritten under them. Records longer than a slot keep their full text in a locked side table,
+    // they're rare enough for that. The view gets new rows appended every refresh interval at most,
+    // the file setting (if set) gets the records appended from a background thread.
+    class LogRing : public QAbstractListModel
+    {
+        Q_OBJECT
+    public:
+        static const int SIZE = 4096; // records kept, power of two
+        static const int TEXT_SIZE = 500; // utf8 bytes kept in the slot, longer ones go to fLong as well
+
+        struct Entry {
+            Entry();
+
+            qint64 fTime; // ms since epoch
+            int fSeverity;
+            QString fMessage;
+        };
+
+        enum LogRoles {
+            DateRole = Qt::UserRole + 1,
+            SeverityRole,
+            MsgRole
+        };
+
+        LogRing(const QString& fileSetting, int refreshInterval);
+        virtual ~LogRing();
+
+        void append(int severity, const QString& message);
+        const QVector<Entry> entries(int minSeverity) const;
+        const QString render(int minSeverity) const;
+        void setLevel(int level);
+
+        QHash<int, QByteArray> roleNames() const;
+        int rowCount(const QModelIndex& parent = QModelIndex()) const;
+        QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+    private slots:
+        void refresh();
+        void flush();
+    private:
+        struct Slot {
+            Slot();
+
+            std::atomic<quint64> fSeq; // 2 * position + 2 once written, odd while being written
+            qint64 fTime;
+            int fSeverity;
+            int fLength;
+            char fText[TEXT_SIZE];
+        };
+
+        QScopedArrayPointer<Slot> fSlots;
+        mutable QMutex fLongMutex;
+        QHash<quint64, QString> fLong; // full text of cut records by position, only the last SIZE positions
+        std::atomic<quint64> fHead; // next position to write
+        quint64 fShown; // next position to go to the view
+        quint64 fFlushed; // next position to go to the log file, only touched on fThread
+        int fLevel;
+        QList<Entry> fRows; // oldest first, at most SIZE
+        QTimer fRefreshTimer;
+        QTimer fFlushTimer;
+        QThread fThread;
+        QObject fWriter; // lives on fThread
+        QFile fFile;
+
+        bool read(quint64 position, Entry& entry) const;
+        bool pending(quint64 position) const;
+        quint64 oldest(quint64 head) const;
+        void write(quint64 head);
+        static const QString severityName(int severity);
+        static const QString formatTime(qint64 time);
+    };
+
+}
+
+#endif // LOGRING_H
@@ -21,6 +21,7 @@
 #include <QApplication>
 #include <QTranslator>
 #include <QQmlApplicationEngine>
+#include <QQuickWindow>
 #include <QDir>
 #include <QQmlContext>
 #include <QtQml/qqml.h>
@@ -44,7 +45,12 @@
 #include "nodemanager.h"
 #include "helpers.h"
 #include "nodews.h"
-#include "trezor/trezor.h"
+#include "rpcmetrics.h"
+#include "nodetraffic.h"
+#include "startupscheduler.h"
+#include "statesnapshot.h"
+#include "settingsstore.h"
+#include "trezor/devicepool.h"
 #include "platform/devicemanager.h"
 #include "cert.h"
 
@@ -58,6 +64,7 @@ using namespace Etherwall;
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    StartupScheduler startup; // first so time-to-interactive covers all of main
 
     qmlRegisterType<AccountProxyModel>("AccountProxyModel", 0, 1, "AccountProxyModel");
 
@@ -86,6 +93,7 @@ int main(int argc, char *argv[])
 
     ClipboardAdapter clipboard;
     EtherLogApp log; // important to be first (apart from clipboard)
+    SettingsStore settingsStore; // before the models, goes away after them
     NodeManager nodeManager;
     GethLogApp gethLog;
 
@@ -95,29 +103,53 @@ int main(int argc, char *argv[])
 //    sslConfig.addCaCertificate(certificate);
 
     Initializer initializer(gethPath, sslConfig);
-    Trezor::TrezorDevice trezor;
+    Trezor::DevicePool trezor;
     DeviceManager deviceManager(app);
+    NodeTraffic nodeTraffic;
     NodeWS ipc(gethLog);
+    RpcMetrics rpcMetrics(ipc);
     CurrencyModel currencyModel(sslConfig);
-    AccountModel accountModel(ipc, currencyModel, trezor);
+    NonceManager nonceManager(ipc);
+    AccountModel accountModel(ipc, currencyModel, trezor, nonceManager);
     TransactionModel transactionModel(ipc, accountModel, sslConfig);
     ContractModel contractModel(ipc, accountModel);
-    FilterModel filterModel(ipc);
-    EventModel eventModel(contractModel, filterModel);
+    EventCache eventCache;
+    FilterModel filterModel(ipc, eventCache);
+    EventModel eventModel(contractModel, filterModel, eventCache);
 
     TokenModel tokenModel(&contractModel);
 
+    // show the last known state right away, the node reconciles it once connected
+    StateSnapshot snapshot(ipc);
+    if ( snapshot.load() ) {
+        accountModel.restoreSnapshot(snapshot.accounts());
+        contractModel.restoreSnapshot(snapshot.contracts());
+        transactionModel.restoreSnapshot(snapshot.transactions(), snapshot.blockNumber());
+    }
+
     // main connections
-    QObject::connect(&initializer, &Initializer::initDone, &ipc, &NodeWS::start);
+    QObject::connect(&initializer, &Initializer::initDone, &nodeTraffic, &NodeTraffic::onInitDone);
+    QObject::connect(&nodeTraffic, &NodeTraffic::initDone, &ipc, &NodeWS::start);
     QObject::connect(&ipc, &NodeWS::clientVersionChanged, &nodeManager, &NodeManager::onClientVersionChanged);
     QObject::connect(&accountModel, &AccountModel::accountsReady, &deviceManager, &DeviceManager::startProbe);
     QObject::connect(&contractModel, &ContractModel::tokenBalanceDone, &accountModel, &AccountModel::onTokenBalanceDone);
+    QObject::connect(&contractModel, &ContractModel::logsFetched, &filterModel, &FilterModel::onLogsFetched);
+    QObject::connect(&contractModel, &ContractModel::logsLost, &filterModel, &FilterModel::onLogsLost);
     QObject::connect(&transactionModel, &TransactionModel::confirmedTransaction, &contractModel, &ContractModel::onConfirmedTransaction);
-    QObject::connect(&accountModel, &AccountModel::accountsReady, &filterModel, &FilterModel::reload);
     QObject::connect(&tokenModel, &TokenModel::selectedTokenContract, &contractModel, &ContractModel::onSelectedTokenContract);
-    QObject::connect(&deviceManager, &DeviceManager::deviceInserted, &trezor, &Trezor::TrezorDevice::onDeviceInserted);
-    QObject::connect(&deviceManager, &DeviceManager::deviceRemoved, &trezor, &Trezor::TrezorDevice::onDeviceRemoved);
-    QObject::connect(&trezor, &Trezor::TrezorDevice::transactionReady, &transactionModel, &TransactionModel::onRawTransaction);
+    QObject::connect(&deviceManager, &DeviceManager::deviceInserted, &trezor, &Trezor::DevicePool::onDeviceInserted);
+    QObject::connect(&deviceManager, &DeviceManager::deviceRemoved, &trezor, &Trezor::DevicePool::onDeviceRemoved);
+    QObject::connect(&trezor, &Trezor::DevicePool::transactionReady, &transactionModel, &TransactionModel::onRawTransaction);
+    QObject::connect(&trezor, &Trezor::DevicePool::deviceFailure, &transactionModel, &TransactionModel::onSignFailure);
+
+    // staged startup, accounts first then history, contracts and tokens, log backfill last
+    QObject::connect(&accountModel, &AccountModel::accountsReady, &startup, [&]() {
+        startup.schedule("transactions", StartupScheduler::High, [&transactionModel]() { transactionModel.refresh(); });
+        startup.schedule("contracts", StartupScheduler::Normal, [&contractModel]() { contractModel.reload(); });
+        startup.schedule("tokens", StartupScheduler::Normal, [&contractModel]() { contractModel.refreshTokens(); });
+        startup.schedule("history", StartupScheduler::Low, [&transactionModel]() { transactionModel.loadHistory(); });
+        startup.schedule("filters", StartupScheduler::Low, [&filterModel]() { filterModel.reload(); });
+    });
 
     // for QML only
     QmlHelpers qmlHelpers;
@@ -128,8 +160,10 @@ int main(int argc, char *argv[])
     engine.rootContext()->setContextProperty("initializer", &initializer);
     engine.rootContext()->setContextProperty("nodeManager", &nodeManager);
     engine.rootContext()->setContextProperty("ipc", &ipc);
+    engine.rootContext()->setContextProperty("rpcMetrics", &rpcMetrics);
     engine.rootContext()->setContextProperty("trezor", &trezor);
     engine.rootContext()->setContextProperty("accountModel", &accountModel);
+    engine.rootContext()->setContextProperty("nonceManager", &nonceManager);
     engine.rootContext()->setContextProperty("transactionModel", &transactionModel);
     engine.rootContext()->setContextProperty("contractModel", &contractModel);
     engine.rootContext()->setContextProperty("filterModel", &filterModel);
@@ -137,16 +171,28 @@ int main(int argc, char *argv[])
     engine.rootContext()->setContextProperty("currencyModel", &currencyModel);
     engine.rootContext()->setContextProperty("clipboard", &clipboard);
     engine.rootContext()->setContextProperty("log", &log);
+    engine.rootContext()->setContextProperty("logRing", &log.ring());
     engine.rootContext()->setContextProperty("geth", &gethLog);
+    engine.rootContext()->setContextProperty("gethRing", &gethLog.ring());
     engine.rootContext()->setContextProperty("helpers", &qmlHelpers);
 
     engine.rootContext()->setContextProperty("tokenModel", &tokenModel);
+    engine.rootContext()->setContextProperty("startup", &startup);
 
     engine.load(QUrl(QStringLiteral("qrc:///main.qml")));
 
+    QQuickWindow* window = qobject_cast<QQuickWindow*>(engine.rootObjects().value(0));
+    if ( window != nullptr ) {
+        QObject::connect(window, &QQuickWindow::frameSwapped, &startup, &StartupScheduler::markInteractive);
+    }
+
     if ( settings.contains("program/v2firstrun") ) {
         initializer.start();
     }
 
-    return app.exec();
+    const int result = app.exec();
+    snapshot.save(accountModel, contractModel, transactionModel);
+    SettingsStore::flush();
+
+    return result;
 }
@@ -0,0 +1,341 @@
+#include "nodetraffic.h"
+#include "etherlogapp.h"
+#include <QSettings>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QHostAddress>
+#include <QPointer>
+#include <QTimer>
+
+namespace Etherwall {
+
+    const quint32 TRAFFIC_MAGIC = 0x45575452; // "EWTR"
+    const quint16 TRAFFIC_VERSION = 1;
+    const quint8 TRAFFIC_COMPRESSED = 0x80; // direction flag for qCompress-ed payloads
+    const int TRAFFIC_COMPRESS_MIN = 512; // smaller payloads are stored as they are
+
+    NodeTraffic::Frame::Frame() : fDirection(0), fTime(0), fPayload()
+    {
+    }
+
+    NodeTraffic::Answer::Answer() : fLatency(0), fReply()
+    {
+    }
+
+    NodeTraffic::NodeTraffic() : QObject(nullptr),
+        fMode(Off), fFileName(), fSpeed(1.0), fServer("Etherwall traffic", QWebSocketServer::NonSecureMode),
+        fClient(nullptr), fUpstream(), fEndpoint(), fPending(), fFile(), fStream(), fClock(),
+        fAnswers(), fLastAnswers(), fNotifications()
+    {
+        const QSettings settings;
+        const QString mode = settings.value("diagnostics/trafficMode").toString();
+        fFileName = settings.value("diagnostics/trafficFile").toString();
+        fSpeed = settings.value("diagnostics/replaySpeed", 1.0).toDouble();
+
+        if ( mode == "record" ) {
+            fMode = Record;
+        } else if ( mode == "replay" ) {
+            fMode = Replay;
+        } else if ( !mode.isEmpty() ) {
+            EtherLog::logMsg("Unknown traffic mode: " + mode, LS_Warning);
+        }
+
+        if ( fMode != Off && fFileName.isEmpty() ) {
+            EtherLog::logMsg("Traffic " + mode + " needs diagnostics/trafficFile, disabled", LS_Warning);
+            fMode = Off;
+        }
+
+        connect(&fServer, &QWebSocketServer::newConnection, this, &NodeTraffic::onNewConnection);
+        connect(&fUpstream, &QWebSocket::connected, this, &NodeTraffic::onUpstreamConnected);
+        connect(&fUpstream, &QWebSocket::textMessageReceived, this, &NodeTraffic::onUpstreamMessage);
+        connect(&fUpstream, &QWebSocket::disconnected, this, &NodeTraffic::onUpstreamDisconnected);
+    }
+
+    NodeTraffic::~NodeTraffic()
+    {
+        fServer.close();
+        if ( fFile.isOpen() ) {
+            fFile.close();
+        }
+    }
+
+    NodeTraffic::Mode NodeTraffic::getMode() const
+    {
+        return fMode;
+    }
+
+    void NodeTraffic::onInitDone(const QString& gethPath, const QString& version, const QString& endpoint, const QString& warning)
+    {
+        try {
+            const bool webSocket = endpoint.startsWith("ws://") || endpoint.startsWith("wss://");
+            if ( fMode == Record && !webSocket ) {
+                // IPC to a local node doesn't go through a socket we can stand in front of
+                EtherLog::logMsg("Traffic record skipped, only websocket endpoints can be recorded, not IPC", LS_Warning);
+                fMode = Off;
+                return emit initDone(gethPath, version, endpoint, warning);
+            }
+
+            if ( fMode == Record ) {
+                openTrace();
+                fEndpoint = endpoint;
+            } else if ( fMode == Replay ) {
+                loadTrace();
+            } else {
+                return emit initDone(gethPath, version, endpoint, warning);
+            }
+
+            if ( !listen() ) {
+                throw QString("unable to listen: " + fServer.errorString());
+            }
+        } catch ( QString err ) {
+            EtherLog::logMsg("Traffic " + QString(fMode == Record ? "record" : "replay") + " disabled, " + err, LS_Error);
+            fMode = Off;
+            return emit initDone(gethPath, version, endpoint, warning);
+        }
+
+        const QString local = "ws://127.0.0.1:" + QString::number(fServer.serverPort());
+        EtherLog::logMsg("Node traffic " + QString(fMode == Record ? "recorded to " : "replayed from ") + fFileName + " via " + local);
+        // a replay runs offline, don't hold it up on warnings from the server check
+        emit initDone(gethPath, version, local, fMode == Replay ? QString() : warning);
+    }
+
+    void NodeTraffic::onNewConnection()
+    {
+        QWebSocket* client = fServer.nextPendingConnection();
+        if ( client == nullptr ) {
+            return;
+        }
+
+        // NodeWS keeps a single connection, a new one replaces the old
+        if ( fClient != nullptr ) {
+            fClient->disconnect(this);
+            fClient->close();
+            fClient->deleteLater();
+        }
+
+        fClient = client;
+        connect(fClient, &QWebSocket::textMessageReceived, this, &NodeTraffic::onClientMessage);
+        connect(fClient, &QWebSocket::disconnected, this, &NodeTraffic::onClientDisconnected);
+
+        if ( fMode == Record ) {
+            if ( !fClock.isValid() ) {
+                fClock.start();
+            }
+            fPending.clear();
+            fUpstream.open(QUrl(fEndpoint));
+            return;
+        }
+
+        // replay notifications relative to when the client showed up
+        fClock.start();
+        foreach ( const Frame& frame, fNotifications ) {
+            sendLater(frame.fPayload, frame.fTime);
+        }
+    }
+
+    void NodeTraffic::onClientMessage(const QString& message)
+    {
+        if ( fMode == Record ) {
+            writeFrame(Request, message);
+            if ( fUpstream.state() == QAbstractSocket::ConnectedState ) {
+                fUpstream.sendTextMessage(message);
+            } else {
+                fPending.enqueue(message);
+            }
+            return;
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8(), &parseError);
+        if ( parseError.error != QJsonParseError::NoError || !doc.isObject() ) {
+            EtherLog::logMsg("Traffic replay ignoring unsupported request: " + message, LS_Warning);
+            return;
+        }
+
+        answer(doc.object());
+    }
+
+    void NodeTraffic::onClientDisconnected()
+    {
+        QWebSocket* client = qobject_cast<QWebSocket*>(sender());
+        if ( client == nullptr || client != fClient ) {
+            return;
+        }
+
+        fClient->deleteLater();
+        fClient = nullptr;
+        fPending.clear();
+        if ( fMode == Record ) {
+            fUpstream.close();
+        }
+    }
+
+    void NodeTraffic::onUpstreamConnected()
+    {
+        while ( !fPending.isEmpty() ) {
+            fUpstream.sendTextMessage(fPending.dequeue());
+        }
+    }
+
+    void NodeTraffic::onUpstreamMessage(const QString& message)
+    {
+        writeFrame(Reply, message);
+        if ( fClient != nullptr ) {
+            fClient->sendTextMessage(message);
+        }
+    }
+
+    void NodeTraffic::onUpstreamDisconnected()
+    {
+        if ( fUpstream.closeCode() != QWebSocketProtocol::CloseCodeNormal ) {
+            EtherLog::logMsg("Traffic upstream disconnected: " + fUpstream.closeReason(), LS_Warning);
+        }
+
+        // let NodeWS see the drop and reconnect through us
+        if ( fClient != nullptr ) {
+            fClient->close();
+        }
+    }
+
+    bool NodeTraffic::listen()
+    {
+        return fServer.isListening() || fServer.listen(QHostAddress::LocalHost, 0);
+    }
+
+    void NodeTraffic::openTrace()
+    {
+        fFile.setFileName(fFileName);
+        if ( !fFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+            throw QString("unable to open " + fFileName + ": " + fFile.errorString());
+        }
+
+        fStream.setDevice(&fFile);
+        fStream.setVersion(QDataStream::Qt_5_6);
+        fStream << TRAFFIC_MAGIC << TRAFFIC_VERSION;
+    }
+
+    void NodeTraffic::loadTrace()
+    {
+        QFile file(fFileName);
+        if ( !file.open(QIODevice::ReadOnly) ) {
+            throw QString("unable to open " + fFileName + ": " + file.errorString());
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_6);
+        quint32 magic = 0;
+        quint16 version = 0;
+        stream >> magic >> version;
+        if ( magic != TRAFFIC_MAGIC || version != TRAFFIC_VERSION ) {
+            throw QString("invalid trace file " + fFileName);
+        }
+
+        fAnswers.clear();
+        fLastAnswers.clear();
+        fNotifications.clear();
+        QHash<QString, QPair<QString, qint64> > requests; // by id, key and time sent
+        int frames = 0;
+
+        while ( !stream.atEnd() ) {
+            Frame frame;
+            stream >> frame.fDirection >> frame.fTime >> frame.fPayload;
+            if ( stream.status() != QDataStream::Ok ) {
+                EtherLog::logMsg("Truncated trace file " + fFileName + " after " + QString::number(frames) + " frames", LS_Warning);
+                break;
+            }
+
+            if ( frame.fDirection & TRAFFIC_COMPRESSED ) {
+                frame.fPayload = qUncompress(frame.fPayload);
+                frame.fDirection &= ~TRAFFIC_COMPRESSED;
+            }
+            frames++;
+
+            const QJsonObject obj = QJsonDocument::fromJson(frame.fPayload).object();
+            if ( obj.isEmpty() ) {
+                continue;
+            }
+
+            const QString id = obj.value("id").toVariant().toString();
+            if ( frame.fDirection == Request ) {
+                requests.insert(id, QPair<QString, qint64>(requestKey(obj), frame.fTime));
+            } else if ( !obj.contains("id") ) {
+                fNotifications.append(frame);
+            } else if ( requests.contains(id) ) {
+                const QPair<QString, qint64> request = requests.take(id);
+                Answer answer;
+                answer.fLatency = frame.fTime - request.second;
+                answer.fReply = obj;
+                fAnswers[request.first].enqueue(answer);
+            }
+        }
+
+        EtherLogApp::log(LS_Debug, [&]() { return "Loaded " + QString::number(frames) + " frames from trace " + fFileName; });
+    }
+
+    void NodeTraffic::writeFrame(Direction direction, const QString& message)
+    {
+        if ( !fFile.isOpen() ) {
+            return;
+        }
+
+        quint8 flags = direction;
+        QByteArray payload = message.toUtf8();
+        if ( payload.size() >= TRAFFIC_COMPRESS_MIN ) {
+            payload = qCompress(payload);
+            flags |= TRAFFIC_COMPRESSED;
+        }
+
+        fStream << flags << (qint64)(fClock.nsecsElapsed() / 1000) << payload;
+    }
+
+    void NodeTraffic::answer(const QJsonObject& request)
+    {
+        const QString key = requestKey(request);
+        Answer answer;
+        QQueue<Answer>& queue = fAnswers[key];
+
+        // same requests get their replies in recorded order, the last one repeats when we run out
+        if ( !queue.isEmpty() ) {
+            answer = queue.dequeue();
+            fLastAnswers.insert(key, answer);
+        } else if ( fLastAnswers.contains(key) ) {
+            answer = fLastAnswers.value(key);
+        } else {
+            QJsonObject error;
+            error.insert("code", -32000);
+            error.insert("message", QString("not in trace"));
+            answer.fReply.insert("jsonrpc", QString("2.0"));
+            answer.fReply.insert("error", error);
+            EtherLog::logMsg("Traffic replay has no reply for " + key, LS_Warning);
+        }
+
+        answer.fReply.insert("id", request.value("id"));
+        sendLater(QJsonDocument(answer.fReply).toJson(QJsonDocument::Compact), answer.fLatency);
+    }
+
+    void NodeTraffic::sendLater(const QByteArray& payload, qint64 usecs)
+    {
+        QPointer<QWebSocket> client(fClient);
+        if ( client.isNull() ) {
+            return;
+        }
+
+        if ( fSpeed <= 0.0 || usecs <= 0 ) {
+            client->sendTextMessage(QString::fromUtf8(payload));
+            return;
+        }
+
+        QTimer::singleShot(qRound64(usecs / 1000.0 / fSpeed), this, [client, payload]() {
+            if ( !client.isNull() ) {
+                client->sendTextMessage(QString::fromUtf8(payload));
+            }
+        });
+    }
+
+    const QString NodeTraffic::requestKey(const QJsonObject& request)
+    {
+        const QJsonArray params = request.value("params").toArray();
+        return request.value("method").toString() + QString::fromUtf8(QJsonDocument(params).toJson(QJsonDocument::Compact));
+    }
+
+}
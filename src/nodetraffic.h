@@ -0,0 +1,95 @@
+#ifndef NODETRAFFIC_H
+#define NODETRAFFIC_H
+
+#include <QObject>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDataStream>
+#include <QJsonValue>
+#include <QJsonObject>
+#include <QHash>
+#include <QQueue>
+#include <QVector>
+
+namespace Etherwall {
+
+    // sits between the initializer and NodeWS as a local websocket endpoint. In record mode
+    // frames are forwarded to the real node and written to a trace file with timestamps,
+    // in replay mode the node is served from a trace so sessions can be re-run offline.
+    // Controlled by diagnostics/trafficMode (record|replay), diagnostics/trafficFile and
+    // diagnostics/replaySpeed (1 = original timing, 0 = no delays).
+    class NodeTraffic : public QObject
+    {
+        Q_OBJECT
+    public:
+        enum Mode {
+            Off,
+            Record,
+            Replay
+        };
+
+        NodeTraffic();
+        virtual ~NodeTraffic();
+
+        Mode getMode() const;
+    signals:
+        void initDone(const QString& gethPath, const QString& version, const QString& endpoint, const QString& warning) const;
+    public slots:
+        void onInitDone(const QString& gethPath, const QString& version, const QString& endpoint, const QString& warning);
+    private slots:
+        void onNewConnection();
+        void onClientMessage(const QString& message);
+        void onClientDisconnected();
+        void onUpstreamConnected();
+        void onUpstreamMessage(const QString& message);
+        void onUpstreamDisconnected();
+    private:
+        enum Direction {
+            Request = 0,
+            Reply = 1
+        };
+
+        struct Frame {
+            Frame();
+
+            quint8 fDirection;
+            qint64 fTime; // microseconds since the recording started
+            QByteArray fPayload;
+        };
+
+        struct Answer {
+            Answer();
+
+            qint64 fLatency; // microseconds between request and reply when recorded
+            QJsonObject fReply;
+        };
+
+        Mode fMode;
+        QString fFileName;
+        double fSpeed;
+        QWebSocketServer fServer;
+        QWebSocket* fClient;
+        QWebSocket fUpstream;
+        QString fEndpoint;
+        QQueue<QString> fPending; // client frames sent before upstream connected
+        QFile fFile;
+        QDataStream fStream;
+        QElapsedTimer fClock;
+        QHash<QString, QQueue<Answer> > fAnswers; // by request method + params
+        QHash<QString, Answer> fLastAnswers; // reused once a queue runs dry
+        QVector<Frame> fNotifications; // replies without an id, replayed on the timeline
+
+        bool listen();
+        void openTrace();
+        void loadTrace();
+        void writeFrame(Direction direction, const QString& message);
+        void answer(const QJsonObject& request);
+        void sendLater(const QByteArray& payload, qint64 usecs);
+        static const QString requestKey(const QJsonObject& request);
+    };
+
+}
+
+#endif // NODETRAFFIC_H
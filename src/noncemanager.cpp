@@ -0,0 +1,142 @@
+#include "noncemanager.h"
+#include "helpers.h"
+#include "etherlog.h"
+
+namespace Etherwall {
+
+    // reservations the node still hasn't counted after this many blocks are considered dropped
+    static const quint64 NONCE_STALE_BLOCKS = 50;
+
+    NonceManager::NonceManager(NodeIPC& ipc) : QObject(nullptr),
+        fAccounts(), fBlockNumber(0)
+    {
+        connect(&ipc, &NodeIPC::newBlock, this, &NonceManager::newBlock);
+    }
+
+    quint64 NonceManager::next(const QString& address, quint64 nodeNonce) const
+    {
+        const AccountNonces nonces = fAccounts.value(address.toLower());
+        quint64 result = qMax(nodeNonce, nonces.fNodeNonce);
+        while ( nonces.fPending.contains(result) ) {
+            result++; // lowest free one, fills gaps left by released reservations
+        }
+
+        return result;
+    }
+
+    quint64 NonceManager::reserve(const QString& address, quint64 nodeNonce, const QString& tag)
+    {
+        const quint64 result = next(address, nodeNonce);
+        Reservation reservation;
+        reservation.fTag = tag;
+        reservation.fBlock = fBlockNumber;
+        account(address, nodeNonce).fPending.insert(result, reservation);
+
+        emit pendingChanged(address.toLower());
+        return result;
+    }
+
+    void NonceManager::commit(const QString& tag)
+    {
+        QMutableMapIterator<QString, AccountNonces> accounts(fAccounts);
+        while ( accounts.hasNext() ) {
+            QMutableMapIterator<quint64, Reservation> pending(accounts.next().value().fPending);
+            while ( pending.hasNext() ) {
+                if ( pending.next().value().fTag == tag ) {
+                    pending.value().fTag = QString();
+                }
+            }
+        }
+    }
+
+    void NonceManager::release(const QString& tag)
+    {
+        if ( tag.isEmpty() ) {
+            return;
+        }
+
+        QMutableMapIterator<QString, AccountNonces> accounts(fAccounts);
+        while ( accounts.hasNext() ) {
+            accounts.next();
+            QMutableMapIterator<quint64, Reservation> pending(accounts.value().fPending);
+            bool changed = false;
+            while ( pending.hasNext() ) {
+                if ( pending.next().value().fTag == tag ) {
+                    pending.remove(); // signing failed, nonce goes back
+                    changed = true;
+                }
+            }
+
+            if ( changed ) {
+                emit pendingChanged(accounts.key());
+            }
+        }
+    }
+
+    void NonceManager::update(const QString& address, quint64 nodeNonce)
+    {
+        AccountNonces& nonces = account(address, nodeNonce);
+        nonces.fNodeNonce = nodeNonce;
+
+        // everything below the node count is mined, by us or a replacement or another wallet
+        bool changed = false;
+        while ( !nonces.fPending.isEmpty() && nonces.fPending.firstKey() < nodeNonce ) {
+            nonces.fPending.erase(nonces.fPending.begin());
+            changed = true;
+        }
+
+        if ( changed ) {
+            emit pendingChanged(address.toLower());
+        }
+    }
+
+    int NonceManager::pendingCount(const QString& address) const
+    {
+        return fAccounts.value(address.toLower()).fPending.size();
+    }
+
+    void NonceManager::newBlock(const QJsonObject& block)
+    {
+        const quint64 blockNum = Helpers::toQUInt64(block.value("number"));
+        if ( blockNum == 0 ) {
+            return; // pending block
+        }
+        fBlockNumber = blockNum;
+
+        // sent but never counted by the node, e.g. dropped from the pool. Free them so the account
+        // doesn't get stuck behind a gap, signers still holding one are left alone
+        QMutableMapIterator<QString, AccountNonces> accounts(fAccounts);
+        while ( accounts.hasNext() ) {
+            accounts.next();
+            QMutableMapIterator<quint64, Reservation> pending(accounts.value().fPending);
+            bool changed = false;
+            while ( pending.hasNext() ) {
+                Reservation& reservation = pending.next().value();
+                if ( reservation.fBlock == 0 ) {
+                    reservation.fBlock = blockNum; // reserved before we saw any block
+                } else if ( reservation.fTag.isEmpty() && blockNum > reservation.fBlock + NONCE_STALE_BLOCKS ) {
+                    EtherLog::logMsg("Dropping stale nonce reservation " + QString::number(pending.key()) + " for " + accounts.key(), LS_Warning);
+                    pending.remove();
+                    changed = true;
+                }
+            }
+
+            if ( changed ) {
+                emit pendingChanged(accounts.key());
+            }
+        }
+    }
+
+    NonceManager::AccountNonces& NonceManager::account(const QString& address, quint64 nodeNonce)
+    {
+        const QString key = address.toLower();
+        if ( !fAccounts.contains(key) ) {
+            AccountNonces nonces;
+            nonces.fNodeNonce = nodeNonce;
+            fAccounts.insert(key, nonces);
+        }
+
+        return fAccounts[key];
+    }
+
+}
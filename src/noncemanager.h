@@ -0,0 +1,54 @@
+#ifndef NONCEMANAGER_H
+#define NONCEMANAGER_H
+
+#include <QObject>
+#include <QMap>
+#include <QJsonObject>
+#include "nodeipc.h"
+
+namespace Etherwall {
+
+    // hands out nonces ahead of the node. A reservation stays pending until the node's transaction count
+    // passes it, so quick successive sends from one account don't wait for a block. Released reservations
+    // leave a gap that the next reserve fills first, ones the node never sees are dropped after a while.
+    // Replacements need no bookkeeping, update() drops whatever is below the node's count once one is mined.
+    class NonceManager : public QObject
+    {
+        Q_OBJECT
+    public:
+        NonceManager(NodeIPC& ipc);
+
+        quint64 next(const QString& address, quint64 nodeNonce) const;
+        quint64 reserve(const QString& address, quint64 nodeNonce, const QString& tag);
+        void commit(const QString& tag);
+        void release(const QString& tag);
+        void update(const QString& address, quint64 nodeNonce);
+        Q_INVOKABLE int pendingCount(const QString& address) const;
+    signals:
+        void pendingChanged(const QString& address) const;
+    private slots:
+        void newBlock(const QJsonObject& block);
+    private:
+        struct Reservation {
+            Reservation() : fTag(), fBlock(0) {}
+
+            QString fTag; // signer still working on it, empty once the tx is out
+            quint64 fBlock; // block it was reserved at
+        };
+
+        struct AccountNonces {
+            AccountNonces() : fNodeNonce(0), fPending() {}
+
+            quint64 fNodeNonce;
+            QMap<quint64, Reservation> fPending;
+        };
+
+        QMap<QString, AccountNonces> fAccounts; // lowercase address
+        quint64 fBlockNumber;
+
+        AccountNonces& account(const QString& address, quint64 nodeNonce);
+    };
+
+}
+
+#endif // NONCEMANAGER_H
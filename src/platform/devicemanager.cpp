@@ -1,11 +1,15 @@
 #include "devicemanager.h"
 #include <QDebug>
+#if defined(Q_OS_LINUX) || defined(Q_OS_MACX)
+#include "trezor/wire.h"
+#endif
 
 namespace Etherwall {
 
 #ifdef Q_OS_MACX
 
-    DeviceManager::DeviceManager(QApplication& app) : QThread(0)
+    DeviceManager::DeviceManager(QApplication& app) : QThread(0),
+        fNotifyPort(nullptr), fRawAddedIter(0), fRawRemovedIter(0), fRaw2AddedIter(0), fRaw2RemovedIter(0)
     {
         Q_UNUSED(app);
         // SEE https://developer.apple.com/library/content/documentation/DeviceDrivers/Conceptual/USBBook/USBDeviceInterfaces/USBDevInterfaces.html#//apple_ref/doc/uid/TP40002645-BBIDDHCI
@@ -35,7 +39,7 @@ namespace Etherwall {
             }
 
             DeviceManager* manager = (DeviceManager*) refCon;
-            emit manager->deviceInserted();
+            emit manager->deviceInserted(QString());
             refCon = nullptr; // finish loop but don't emit again
         }
     }
@@ -58,93 +62,70 @@ namespace Etherwall {
             }
 
             DeviceManager* manager = (DeviceManager*) refCon;
-            emit manager->deviceRemoved();
+            emit manager->deviceRemoved(QString());
             refCon = nullptr; // finish loop but don't emit again
         }
     }
 
-    void DeviceManager::run()
+    // arrival/termination notifications for one vid/pid, both iterators have to be drained to arm them
+    bool DeviceManager::addNotifications(SInt32 vendor, SInt32 product, io_iterator_t& added, io_iterator_t& removed)
     {
-        while ( true ) {
-            sleep(2);
-            emit deviceInserted();
+        CFMutableDictionaryRef matchingDict = IOServiceMatching(kIOUSBDeviceClassName);
+        if ( !matchingDict ) {
+            qDebug() << "Couldn’t create a USB matching dictionary\n";
+            return false;
         }
 
-        // The following works on detection but somehow breaks hidapi and hid_enumerate gets nothing afterwards
+        CFNumberRef vendorRef = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &vendor);
+        CFNumberRef productRef = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &product);
+        CFDictionarySetValue(matchingDict, CFSTR(kUSBVendorName), vendorRef);
+        CFDictionarySetValue(matchingDict, CFSTR(kUSBProductName), productRef);
+        CFRelease(vendorRef);
+        CFRelease(productRef);
 
-        mach_port_t             masterPort;
-        CFMutableDictionaryRef  matchingDict;
-        CFRunLoopSourceRef      runLoopSource;
-        kern_return_t           kr;
-        SInt32                  usbVendor = 0x534c;
-        SInt32                  usbProduct = 0x0001;
+        // each IOServiceAddMatchingNotification consumes one reference
+        matchingDict = (CFMutableDictionaryRef) CFRetain(matchingDict);
 
-        //Create a master port for communication with the I/O Kit
-        kr = IOMasterPort(MACH_PORT_NULL, &masterPort);
-        if (kr || !masterPort)
-        {
-            qDebug() << "ERR: Couldn’t create a master I/O Kit port: " << kr << "\n";
-            return;
+        kern_return_t kr = IOServiceAddMatchingNotification(fNotifyPort, kIOFirstMatchNotification, matchingDict,
+                                                            RawDeviceAdded, this, &added);
+        if ( kr != KERN_SUCCESS ) {
+            qDebug() << "Couldn’t add USB arrival notification: " << kr << "\n";
+            CFRelease(matchingDict);
+            return false;
         }
-        //Set up matching dictionary for class IOUSBDevice and its subclasses
-        matchingDict = IOServiceMatching(kIOUSBDeviceClassName);
-        if (!matchingDict)
-        {
-            qDebug() << "Couldn’t create a USB matching dictionary\n";
-            mach_port_deallocate(mach_task_self(), masterPort);
-            return;
+        RawDeviceAdded(nullptr, added); // already present ones were seen by the startup probe
+
+        kr = IOServiceAddMatchingNotification(fNotifyPort, kIOTerminatedNotification, matchingDict,
+                                              RawDeviceRemoved, this, &removed);
+        if ( kr != KERN_SUCCESS ) {
+            qDebug() << "Couldn’t add USB removal notification: " << kr << "\n";
+            return false;
         }
+        RawDeviceRemoved(nullptr, removed);
 
-        //Add the vendor and product IDs to the matching dictionary.
-        //This is the second key in the table of device-matching keys of the
-        //USB Common Class Specification
+        return true;
+    }
 
-        CFDictionarySetValue(matchingDict, CFSTR(kUSBVendorName),
-                            CFNumberCreate(kCFAllocatorDefault,
-                                         kCFNumberSInt32Type, &usbVendor));
-        CFDictionarySetValue(matchingDict, CFSTR(kUSBProductName),
-                            CFNumberCreate(kCFAllocatorDefault,
-                                        kCFNumberSInt32Type, &usbProduct));
+    void DeviceManager::run()
+    {
+        // notifications instead of polling, hidapi is only touched on the TREZOR side when one arrives
+        fNotifyPort = IONotificationPortCreate(kIOMasterPortDefault);
+        if ( fNotifyPort == nullptr ) {
+            qDebug() << "ERR: Couldn’t create an I/O Kit notification port\n";
+            return;
+        }
 
-        //To set up asynchronous notifications, create a notification port and
-        //add its run loop event source to the program’s run loop
-        fNotifyPort = IONotificationPortCreate(masterPort);
-        runLoopSource = IONotificationPortGetRunLoopSource(fNotifyPort);
-        CFRunLoopAddSource(CFRunLoopGetCurrent(), runLoopSource,
-                            kCFRunLoopDefaultMode);
+        CFRunLoopAddSource(CFRunLoopGetCurrent(), IONotificationPortGetRunLoopSource(fNotifyPort), kCFRunLoopDefaultMode);
+
+        addNotifications(TREZOR1_VID, TREZOR1_PID, fRawAddedIter, fRawRemovedIter);
+        addNotifications(TREZOR2_VID, TREZOR2_PID, fRaw2AddedIter, fRaw2RemovedIter);
 
-        //Retain additional dictionary references because each call to
-        //IOServiceAddMatchingNotification consumes one reference
-        matchingDict = (CFMutableDictionaryRef) CFRetain(matchingDict);
-        matchingDict = (CFMutableDictionaryRef) CFRetain(matchingDict);
-        // matchingDict = (CFMutableDictionaryRef) CFRetain(matchingDict);
-
-        //Now set up two notifications: one to be called when a raw device
-        //is first matched by the I/O Kit and another to be called when the
-        //device is terminated
-        //Notification of first match:
-        kr = IOServiceAddMatchingNotification(fNotifyPort,
-                        kIOFirstMatchNotification, matchingDict,
-                        RawDeviceAdded, this, &fRawAddedIter);
-        RawDeviceAdded(nullptr, fRawAddedIter);
-
-        //Notification of termination:
-        kr = IOServiceAddMatchingNotification(fNotifyPort,
-                        kIOTerminatedNotification, matchingDict,
-                        RawDeviceRemoved, this, &fRawRemovedIter);
-        RawDeviceRemoved(nullptr, fRawRemovedIter);
-
-        mach_port_deallocate(mach_task_self(), masterPort);
-        masterPort = 0;
-
-        //Start the run loop so notifications will be received
-        qDebug() << "Running notification loop\n";
         CFRunLoopRun();
     }
 
     void DeviceManager::startProbe() {
         start();
-        emit deviceInserted(); // we only get changes so check initially
+        emit deviceInserted(QString()); // we only get changes so check initially
     }
 
 #endif
@@ -162,7 +143,7 @@ namespace Etherwall {
 
         MSG *msg = static_cast<MSG*>(message);
         if ( msg->message == WM_DEVICECHANGE ) {
-            emit fOwner.deviceInserted(); // insert/remove same in windblows
+            emit fOwner.deviceInserted(QString()); // insert/remove same in windblows
         }
 
         return false;
@@ -188,16 +169,56 @@ namespace Etherwall {
 
     void DeviceManager::startProbe()
     {
-        emit deviceInserted(); // initial check as we don't get a change if it's already inserted
+        emit deviceInserted(QString()); // initial check as we don't get a change if it's already inserted
     }
 #endif
 
 #ifdef Q_OS_LINUX
-    DeviceManager::DeviceManager(QApplication& app) : QThread(nullptr)
+    static bool hasIDs(struct udev_device* usb, quint16 vid, quint16 pid)
+    {
+        const QByteArray vendor(udev_device_get_sysattr_value(usb, "idVendor"));
+        const QByteArray product(udev_device_get_sysattr_value(usb, "idProduct"));
+        return vendor.toUShort(nullptr, 16) == vid && product.toUShort(nullptr, 16) == pid;
+    }
+
+    // TREZOR One is a hidraw node on interface 0 (1 is U2F), model T a raw usb device
+    static bool isTrezorNode(struct udev_device* dev)
+    {
+        const QByteArray subsystem(udev_device_get_subsystem(dev));
+        if ( subsystem == "usb" ) {
+            return QByteArray(udev_device_get_devtype(dev)) == "usb_device" && hasIDs(dev, TREZOR2_VID, TREZOR2_PID);
+        }
+
+        if ( subsystem != "hidraw" ) {
+            return false;
+        }
+
+        struct udev_device* intf = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_interface");
+        struct udev_device* usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+        if ( intf == nullptr || usb == nullptr ) {
+            return false;
+        }
+
+        return QByteArray(udev_device_get_sysattr_value(intf, "bInterfaceNumber")).toInt() == 0 && hasIDs(usb, TREZOR1_VID, TREZOR1_PID);
+    }
+
+    // we link hidapi-libusb which can't open /dev/hidrawN, its paths are "bus:address:interface" in hex
+    static const QString hidapiPath(struct udev_device* dev)
+    {
+        struct udev_device* intf = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_interface");
+        struct udev_device* usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+        const int bus = QByteArray(udev_device_get_sysattr_value(usb, "busnum")).toInt();
+        const int address = QByteArray(udev_device_get_sysattr_value(usb, "devnum")).toInt();
+        const int interface = QByteArray(udev_device_get_sysattr_value(intf, "bInterfaceNumber")).toInt(nullptr, 16);
+
+        return QString("%1:%2:%3").arg(bus, 4, 16, QChar('0')).arg(address, 4, 16, QChar('0')).arg(interface, 2, 16, QChar('0'));
+    }
+
+    DeviceManager::DeviceManager(QApplication& app) : QThread(nullptr), fTrezorNodes()
     {
         Q_UNUSED(app)
         fUdev = udev_new();
-        fUdevMonitor = udev_monitor_new_from_netlink(fUdev, "udev");
+        fUdevMonitor = fUdev != nullptr ? udev_monitor_new_from_netlink(fUdev, "udev") : nullptr;
     }
 
     DeviceManager::~DeviceManager()
@@ -218,23 +239,27 @@ namespace Etherwall {
 
     void DeviceManager::run()
     {
-        /* Set up a monitor to monitor hidraw devices */
+        /* Set up a monitor for hidraw (TREZOR One) and usb (TREZOR T) devices */
         udev_monitor_filter_add_match_subsystem_devtype(fUdevMonitor, "hidraw", nullptr);
+        udev_monitor_filter_add_match_subsystem_devtype(fUdevMonitor, "usb", "usb_device");
         udev_monitor_enable_receiving(fUdevMonitor);
         // make FD blocking
         int fd = udev_monitor_get_fd(fUdevMonitor);
         int flags = fcntl(fd, F_GETFL, 0);
-        fcntl(fd, F_SETFL, flags & !O_NONBLOCK);
+        fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+        // receiving already, so nothing plugged in from here on slips past the one-time walk
+        enumerate();
 
         while (1) {
             struct udev_device* dev = udev_monitor_receive_device(fUdevMonitor);
             if (dev) {
                 const QString action = QString::fromLatin1(udev_device_get_action(dev));
                 if ( action == "add" ) {
-                    emit deviceInserted();
+                    addNode(dev);
                 } else if ( action == "remove" ) {
-                    emit deviceRemoved();
-                } else {
+                    removeNode(dev);
+                } else if ( action != "change" && action != "bind" && action != "unbind" ) {
                     qDebug() << "Unknown udev device action: " << action << "\n";
                 }
                 udev_device_unref(dev);
@@ -246,10 +271,59 @@ namespace Etherwall {
         }
     }
 
+    void DeviceManager::enumerate()
+    {
+        struct udev_enumerate* enumerator = udev_enumerate_new(fUdev);
+        udev_enumerate_add_match_subsystem(enumerator, "hidraw");
+        udev_enumerate_add_match_subsystem(enumerator, "usb");
+        udev_enumerate_scan_devices(enumerator);
+
+        bool found = false;
+        struct udev_list_entry* entry;
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerator)) {
+            struct udev_device* dev = udev_device_new_from_syspath(fUdev, udev_list_entry_get_name(entry));
+            if ( dev != nullptr ) {
+                found = addNode(dev) || found;
+                udev_device_unref(dev);
+            }
+        }
+        udev_enumerate_unref(enumerator);
+
+        if ( !found ) {
+            emit deviceInserted(QString()); // let the transport have its one look, e.g. the emulator is always there
+        }
+    }
+
+    bool DeviceManager::addNode(struct udev_device* dev)
+    {
+        const char* node = udev_device_get_devnode(dev);
+        if ( node == nullptr || !isTrezorNode(dev) ) {
+            return false;
+        }
+
+        const bool hidraw = QByteArray(udev_device_get_subsystem(dev)) == "hidraw";
+        const QString path = hidraw ? hidapiPath(dev) : QString::fromUtf8(node);
+        fTrezorNodes.insert(QString::fromUtf8(udev_device_get_syspath(dev)), path);
+        emit deviceInserted(path);
+        return true;
+    }
+
+    void DeviceManager::removeNode(struct udev_device* dev)
+    {
+        const QString path = fTrezorNodes.take(QString::fromUtf8(udev_device_get_syspath(dev)));
+        if ( !path.isEmpty() ) {
+            emit deviceRemoved(path);
+        }
+    }
+
     void DeviceManager::startProbe()
     {
-        emit deviceInserted();
-        start();
+        if ( fUdevMonitor == nullptr ) {
+            emit deviceInserted(QString()); // no udev, single enumeration on the TREZOR side
+            return;
+        }
+
+        start(); // initial state comes from the enumeration in run()
     }
 #endif
 }
@@ -5,6 +5,7 @@
 #include <QApplication>
 #include <QThread>
 #include <QTimer>
+#include <QHash>
 
 #ifdef Q_OS_MACX
 #include <CoreFoundation.h>
@@ -44,15 +45,20 @@ namespace Etherwall {
         virtual ~DeviceManager();
         void run();
     signals:
-        void deviceInserted() const;
-        void deviceRemoved() const;
+        // path is the TREZOR node if the platform knows it, empty means "something changed, go look"
+        void deviceInserted(const QString& path) const;
+        void deviceRemoved(const QString& path) const;
     public slots:
         void startProbe();
     private:
 #ifdef Q_OS_MACX
         IONotificationPortRef    fNotifyPort;
-        io_iterator_t            fRawAddedIter;
+        io_iterator_t            fRawAddedIter; // TREZOR One
         io_iterator_t            fRawRemovedIter;
+        io_iterator_t            fRaw2AddedIter; // TREZOR T
+        io_iterator_t            fRaw2RemovedIter;
+
+        bool addNotifications(SInt32 vendor, SInt32 product, io_iterator_t& added, io_iterator_t& removed);
 #endif
 #ifdef Q_OS_WIN32
         WindowsUSBFilter fFilter;
@@ -60,6 +66,11 @@ namespace Etherwall {
 #ifdef Q_OS_LINUX
         struct udev* fUdev;
         struct udev_monitor* fUdevMonitor;
+        QHash<QString, QString> fTrezorNodes; // syspath -> devnode, sysfs is gone by the time remove comes
+
+        void enumerate();
+        bool addNode(struct udev_device* dev);
+        void removeNode(struct udev_device* dev);
 #endif
     };
 
@@ -0,0 +1,49 @@
+#include "rowcache.h"
+
+namespace Etherwall {
+
+    RowCache::RowCache(QAbstractItemModel& model, int columns) : QObject(nullptr),
+        fModel(model), fColumns(qMax(1, columns)), fCells()
+    {
+        connect(&fModel, &QAbstractItemModel::dataChanged, this, &RowCache::onDataChanged);
+        connect(&fModel, &QAbstractItemModel::rowsInserted, this, &RowCache::onRowsInserted);
+        connect(&fModel, &QAbstractItemModel::rowsRemoved, this, &RowCache::onRowsRemoved);
+        connect(&fModel, &QAbstractItemModel::rowsMoved, this, &RowCache::clear);
+        connect(&fModel, &QAbstractItemModel::layoutChanged, this, &RowCache::clear);
+        connect(&fModel, &QAbstractItemModel::modelReset, this, &RowCache::clear);
+    }
+
+    void RowCache::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+    {
+        // whole rows, a display value can depend on any role
+        const int first = qMax(0, topLeft.row()) * fColumns;
+        const int end = qMin(fCells.size(), (bottomRight.row() + 1) * fColumns);
+        for ( int at = first; at < end; at++ ) {
+            fCells[at] = QVariant();
+        }
+    }
+
+    void RowCache::onRowsInserted(const QModelIndex& parent, int first, int last)
+    {
+        Q_UNUSED(parent);
+        const int at = first * fColumns;
+        if ( at < fCells.size() ) {
+            fCells.insert(at, (last - first + 1) * fColumns, QVariant());
+        }
+    }
+
+    void RowCache::onRowsRemoved(const QModelIndex& parent, int first, int last)
+    {
+        Q_UNUSED(parent);
+        const int at = first * fColumns;
+        if ( at < fCells.size() ) {
+            fCells.remove(at, qMin((last - first + 1) * fColumns, fCells.size() - at));
+        }
+    }
+
+    void RowCache::clear()
+    {
+        fCells.clear();
+    }
+
+}
@@ -0,0 +1,51 @@
+#ifndef ROWCACHE_H
+#define ROWCACHE_H
+
+#include <QObject>
+#include <QAbstractItemModel>
+#include <QVector>
+#include <QVariant>
+
+namespace Etherwall {
+
+    // display values of a table model, formatted the first time a cell is asked for and
+    // handed out as shared copies after that, so scrolling doesn't format or allocate.
+    // Follows the model's own signals, created in the model constructor so it drops
+    // changed cells before any view gets to re-read them.
+    class RowCache : public QObject
+    {
+        Q_OBJECT
+    public:
+        RowCache(QAbstractItemModel& model, int columns);
+
+        template<typename Formatter>
+        const QVariant display(int row, int column, Formatter format) {
+            if ( row < 0 || column < 0 || column >= fColumns ) {
+                return format();
+            }
+
+            const int at = row * fColumns + column;
+            if ( at >= fCells.size() ) {
+                fCells.resize(qMax(fModel.rowCount(), row + 1) * fColumns);
+            }
+
+            if ( !fCells.at(at).isValid() ) {
+                fCells[at] = format();
+            }
+
+            return fCells.at(at);
+        }
+    private slots:
+        void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+        void onRowsInserted(const QModelIndex& parent, int first, int last);
+        void onRowsRemoved(const QModelIndex& parent, int first, int last);
+        void clear();
+    private:
+        QAbstractItemModel& fModel;
+        const int fColumns;
+        QVector<QVariant> fCells; // row major, invalid until formatted
+    };
+
+}
+
+#endif // ROWCACHE_H
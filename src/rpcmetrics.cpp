@@ -0,0 +1,328 @@
+#include "rpcmetrics.h"
+#include "etherlog.h"
+#include <QSettings>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QtMath>
+
+namespace Etherwall {
+
+    const int RPC_METRICS_HISTORY = 300; // seconds of busy history kept
+
+    RpcMetrics* RpcMetrics::sMetrics = nullptr;
+
+    RpcMetrics::Span::Span(const char* name) :
+        fName(name), fStart(sMetrics != nullptr ? sMetrics->fClock.nsecsElapsed() : -1)
+    {
+    }
+
+    RpcMetrics::Span::~Span()
+    {
+        if ( sMetrics != nullptr && fStart >= 0 ) {
+            sMetrics->record(fName, fStart);
+        }
+    }
+
+    RpcMetrics::MethodStats::MethodStats() :
+        fCount(0), fErrors(0), fTotal(0), fMax(0), fBuckets(BUCKETS, 0)
+    {
+    }
+
+    qint64 RpcMetrics::MethodStats::percentile(double p) const
+    {
+        // upper bound of the bucket the percentile falls into
+        const int wanted = qCeil(fCount * p);
+        int seen = 0;
+        for ( int i = 0; i < BUCKETS; i++ ) {
+            seen += fBuckets.at(i);
+            if ( seen >= wanted && seen > 0 ) {
+                return qMin(fMax, (qint64)1000 << i);
+            }
+        }
+
+        return fMax;
+    }
+
+    RpcMetrics::RpcMetrics(NodeIPC& ipc) : QObject(nullptr),
+        fIpc(ipc), fMutex(), fClock(), fMethods(), fHandlers(), fStart(-1), fMethod(), fFailed(false), fChanged(false), fRequests(0), fErrors(0),
+        fBusySince(-1), fBusyTotal(0), fLastSample(0), fBusyHistory(), fSampleTimer()
+    {
+        fClock.start();
+        sMetrics = this;
+
+        connect(&ipc, &NodeIPC::requestChanged, this, &RpcMetrics::onRequestChanged);
+        // direct so we see the finished request before NodeIPC moves on to the next one
+        connect(&ipc, &NodeIPC::requestDone, this, &RpcMetrics::onRequestDone, Qt::DirectConnection);
+        connect(&ipc, &NodeIPC::error, this, &RpcMetrics::onError, Qt::DirectConnection);
+        connect(&ipc, &NodeIPC::busyChanged, this, &RpcMetrics::onBusyChanged);
+
+        fSampleTimer.setInterval(1000);
+        connect(&fSampleTimer, &QTimer::timeout, this, &RpcMetrics::sample);
+        fSampleTimer.start();
+    }
+
+    RpcMetrics::~RpcMetrics()
+    {
+        sMetrics = nullptr;
+
+        // e.g. for comparing runs, set diagnostics/metricsFile to get a dump on every exit
+        const QSettings settings;
+        const QString fileName = settings.value("diagnostics/metricsFile").toString();
+        if ( !fileName.isEmpty() ) {
+            dump(QUrl::fromLocalFile(fileName));
+        }
+    }
+
+    const QVariantList RpcMetrics::getMethods() const
+    {
+        QMutexLocker locker(&fMutex);
+        QVariantList result;
+        QMap<QString, MethodStats>::const_iterator it;
+        for ( it = fMethods.constBegin(); it != fMethods.constEnd(); ++it ) {
+            result.append(toJson(it.key(), it.value()).toVariantMap());
+        }
+
+        return result;
+    }
+
+    const QVariantList RpcMetrics::getHandlers() const
+    {
+        QMutexLocker locker(&fMutex);
+        QVariantList result;
+        QMap<QString, MethodStats>::const_iterator it;
+        for ( it = fHandlers.constBegin(); it != fHandlers.constEnd(); ++it ) {
+            result.append(toJson(it.key(), it.value()).toVariantMap());
+        }
+
+        return result;
+    }
+
+    int RpcMetrics::getRequestCount() const
+    {
+        QMutexLocker locker(&fMutex);
+        return fRequests;
+    }
+
+    int RpcMetrics::getErrorCount() const
+    {
+        QMutexLocker locker(&fMutex);
+        return fErrors;
+    }
+
+    double RpcMetrics::getBusyRatio() const
+    {
+        return fBusyHistory.isEmpty() ? 0.0 : fBusyHistory.last();
+    }
+
+    const QVariantList RpcMetrics::getBusyHistory() const
+    {
+        QVariantList result;
+        foreach ( double ratio, fBusyHistory ) {
+            result.append(ratio);
+        }
+
+        return result;
+    }
+
+    const QJsonObject RpcMetrics::toJson() const
+    {
+        QJsonObject result;
+        QJsonObject methods;
+        QJsonObject handlers;
+        {
+            QMutexLocker locker(&fMutex);
+            QMap<QString, MethodStats>::const_iterator it;
+            for ( it = fMethods.constBegin(); it != fMethods.constEnd(); ++it ) {
+                methods.insert(it.key(), toJson(it.key(), it.value()));
+            }
+            for ( it = fHandlers.constBegin(); it != fHandlers.constEnd(); ++it ) {
+                handlers.insert(it.key(), toJson(it.key(), it.value()));
+            }
+            result.insert("requests", fRequests);
+            result.insert("errors", fErrors);
+        }
+
+        QJsonArray busy;
+        foreach ( double ratio, fBusyHistory ) {
+            busy.append(ratio);
+        }
+
+        result.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+        result.insert("uptimeMs", fClock.elapsed());
+        result.insert("methods", methods);
+        result.insert("handlers", handlers);
+        result.insert("busyHistory", busy);
+
+        return result;
+    }
+
+    bool RpcMetrics::dump(const QUrl& fileName) const
+    {
+        QSaveFile file(fileName.toLocalFile());
+        if ( !file.open(QIODevice::WriteOnly) ) {
+            EtherLog::logMsg("Unable to write RPC metrics to " + file.fileName() + ": " + file.errorString(), LS_Error);
+            return false;
+        }
+
+        file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+        return file.commit();
+    }
+
+    void RpcMetrics::reset()
+    {
+        {
+            QMutexLocker locker(&fMutex);
+            fMethods.clear();
+            fHandlers.clear();
+            fRequests = 0;
+            fErrors = 0;
+        }
+
+        fBusyHistory.clear();
+        emit metricsChanged();
+    }
+
+    void RpcMetrics::onRequestChanged()
+    {
+        // emitted right before the next request goes out, the active one is still the old one here
+        QMutexLocker locker(&fMutex);
+        const qint64 start = fClock.nsecsElapsed();
+        fStart = start;
+        fMethod = QString();
+        fFailed = false;
+
+        // so pick up the name once it's written, unless it already finished by then
+        QMetaObject::invokeMethod(this, [this, start]() {
+            const QString method = fIpc.getActiveRequestName();
+            QMutexLocker locker(&fMutex);
+            if ( fStart == start && fMethod.isEmpty() ) {
+                fMethod = method;
+            }
+        }, Qt::QueuedConnection);
+    }
+
+    void RpcMetrics::onRequestDone()
+    {
+        const QString active = fIpc.getActiveRequestName(); // stable until NodeIPC's own queued handler runs
+        QMutexLocker locker(&fMutex);
+        if ( fStart < 0 ) {
+            return;
+        }
+
+        const QString method = active.isEmpty() ? fMethod : active; // empty after a bail
+
+        const qint64 usecs = (fClock.nsecsElapsed() - fStart) / 1000;
+        MethodStats& stats = fMethods[method.isEmpty() ? QString("unknown") : method];
+        add(stats, usecs);
+        if ( fFailed ) {
+            stats.fErrors++;
+            fErrors++;
+        }
+
+        fRequests++;
+        fStart = -1;
+        fMethod = QString();
+        fFailed = false;
+        fChanged = true;
+    }
+
+    void RpcMetrics::onError()
+    {
+        QMutexLocker locker(&fMutex);
+        fFailed = true;
+    }
+
+    void RpcMetrics::onBusyChanged()
+    {
+        const qint64 now = fClock.nsecsElapsed();
+        if ( fIpc.getBusy() ) {
+            if ( fBusySince < 0 ) {
+                fBusySince = now;
+            }
+        } else if ( fBusySince >= 0 ) {
+            fBusyTotal += now - qMax(fBusySince, fLastSample);
+            fBusySince = -1;
+        }
+    }
+
+    void RpcMetrics::sample()
+    {
+        const qint64 now = fClock.nsecsElapsed();
+        qint64 busy = fBusyTotal;
+        if ( fBusySince >= 0 ) {
+            busy += now - qMax(fBusySince, fLastSample);
+        }
+
+        const qint64 span = now - fLastSample;
+        fBusyHistory.append(span > 0 ? qMin(1.0, (double)busy / span) : 0.0);
+        if ( fBusyHistory.size() > RPC_METRICS_HISTORY ) {
+            fBusyHistory.removeFirst();
+        }
+        fBusyTotal = 0;
+        fLastSample = now;
+
+        bool changed;
+        {
+            QMutexLocker locker(&fMutex);
+            changed = fChanged;
+            fChanged = false;
+        }
+
+        // the history moves every second anyway, but don't poke QML while idle
+        if ( changed || busy > 0 ) {
+            emit metricsChanged();
+        }
+    }
+
+    void RpcMetrics::add(MethodStats& stats, qint64 usecs)
+    {
+        stats.fCount++;
+        stats.fTotal += usecs;
+        stats.fMax = qMax(stats.fMax, usecs);
+        stats.fBuckets[bucket(usecs)]++;
+    }
+
+    void RpcMetrics::record(const char* name, qint64 start)
+    {
+        const qint64 usecs = (fClock.nsecsElapsed() - start) / 1000;
+        QMutexLocker locker(&fMutex);
+        add(fHandlers[QString::fromLatin1(name)], usecs);
+        fChanged = true;
+    }
+
+    int RpcMetrics::bucket(qint64 usecs)
+    {
+        int result = 0;
+        qint64 limit = 1000;
+        while ( usecs >= limit && result < BUCKETS - 1 ) {
+            limit <<= 1;
+            result++;
+        }
+
+        return result;
+    }
+
+    const QJsonObject RpcMetrics::toJson(const QString& method, const MethodStats& stats) const
+    {
+        QJsonObject result;
+        QJsonArray buckets;
+        foreach ( int count, stats.fBuckets ) {
+            buckets.append(count);
+        }
+
+        result.insert("method", method);
+        result.insert("count", stats.fCount);
+        result.insert("errors", stats.fErrors);
+        result.insert("meanUs", stats.fCount > 0 ? (double)stats.fTotal / stats.fCount : 0.0);
+        result.insert("p50Us", (double)stats.percentile(0.5));
+        result.insert("p95Us", (double)stats.percentile(0.95));
+        result.insert("maxUs", (double)stats.fMax);
+        result.insert("totalUs", (double)stats.fTotal);
+        result.insert("buckets", buckets);
+
+        return result;
+    }
+
+}
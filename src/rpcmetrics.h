@@ -0,0 +1,104 @@
+#ifndef RPCMETRICS_H
+#define RPCMETRICS_H
+
+#include <QObject>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVariantList>
+#include <QUrl>
+#include "nodeipc.h"
+
+namespace Etherwall {
+
+    // per method latency of node requests. NodeIPC runs one request at a time, so a request
+    // starts when the IPC announces it's writing (requestChanged) and ends once its reply
+    // was handled (requestDone, on the handler thread). Model side hot paths are timed with Span.
+    class RpcMetrics : public QObject
+    {
+        Q_OBJECT
+        Q_PROPERTY(QVariantList methods READ getMethods NOTIFY metricsChanged)
+        Q_PROPERTY(QVariantList handlers READ getHandlers NOTIFY metricsChanged)
+        Q_PROPERTY(int requestCount READ getRequestCount NOTIFY metricsChanged)
+        Q_PROPERTY(int errorCount READ getErrorCount NOTIFY metricsChanged)
+        Q_PROPERTY(double busyRatio READ getBusyRatio NOTIFY metricsChanged)
+        Q_PROPERTY(QVariantList busyHistory READ getBusyHistory NOTIFY metricsChanged)
+    public:
+        static const int BUCKETS = 16; // < 1ms, then powers of two up to 16s+
+
+        // times the enclosing scope into the "handlers" section, a no-op without an RpcMetrics around
+        class Span
+        {
+        public:
+            explicit Span(const char* name);
+            ~Span();
+        private:
+            const char* fName;
+            qint64 fStart;
+        };
+
+        RpcMetrics(NodeIPC& ipc);
+        virtual ~RpcMetrics();
+
+        const QVariantList getMethods() const;
+        const QVariantList getHandlers() const;
+        int getRequestCount() const;
+        int getErrorCount() const;
+        double getBusyRatio() const;
+        const QVariantList getBusyHistory() const;
+        const QJsonObject toJson() const;
+
+        Q_INVOKABLE bool dump(const QUrl& fileName) const;
+        Q_INVOKABLE void reset();
+    signals:
+        void metricsChanged() const;
+    private slots:
+        void onRequestChanged();
+        void onRequestDone();
+        void onError();
+        void onBusyChanged();
+        void sample();
+    private:
+        struct MethodStats {
+            MethodStats();
+
+            int fCount;
+            int fErrors;
+            qint64 fTotal; // all in microseconds
+            qint64 fMax;
+            QVector<int> fBuckets;
+
+            qint64 percentile(double p) const;
+        };
+
+        static RpcMetrics* sMetrics;
+
+        NodeIPC& fIpc;
+        mutable QMutex fMutex; // requestDone and error come from the handler thread
+        QElapsedTimer fClock;
+        QMap<QString, MethodStats> fMethods;
+        QMap<QString, MethodStats> fHandlers;
+        qint64 fStart;
+        QString fMethod; // of the request since fStart, bail clears NodeIPC's before reporting
+        bool fFailed;
+        bool fChanged;
+        int fRequests;
+        int fErrors;
+        qint64 fBusySince;
+        qint64 fBusyTotal; // since last sample
+        qint64 fLastSample;
+        QVector<double> fBusyHistory; // busy fraction per second, oldest first
+        QTimer fSampleTimer;
+
+        static int bucket(qint64 usecs);
+        static void add(MethodStats& stats, qint64 usecs);
+        void record(const char* name, qint64 start);
+        const QJsonObject toJson(const QString& method, const MethodStats& stats) const;
+    };
+
+}
+
+#endif // RPCMETRICS_H
@@ -0,0 +1,191 @@
+#include "settingsstore.h"
+#include "etherlog.h"
+#include <QSettings>
+
+namespace Etherwall {
+
+    const int SETTINGS_WRITE_DELAY = 500; // ms to collect writes before one batch goes to disk
+
+    SettingsStore* SettingsStore::sStore = nullptr;
+
+    SettingsStore::SettingsStore() : QObject(nullptr),
+        fPending(), fWriting(), fBusy(false), fThread(), fWriter(), fTimer()
+    {
+        fTimer.setSingleShot(true);
+        fTimer.setInterval(SETTINGS_WRITE_DELAY);
+        connect(&fTimer, &QTimer::timeout, this, &SettingsStore::startWrite);
+
+        fWriter.moveToThread(&fThread);
+        fThread.start(QThread::LowPriority);
+        sStore = this;
+    }
+
+    SettingsStore::~SettingsStore()
+    {
+        flush();
+        sStore = nullptr;
+        fThread.quit();
+        fThread.wait();
+    }
+
+    const QVariant SettingsStore::value(const QString& key, const QVariant& defaultValue)
+    {
+        QVariant result;
+        if ( sStore != nullptr && sStore->lookup(key, result) ) {
+            return result.isValid() ? result : defaultValue;
+        }
+
+        const QSettings settings;
+        return settings.value(key, defaultValue);
+    }
+
+    void SettingsStore::setValue(const QString& key, const QVariant& value)
+    {
+        if ( sStore == nullptr ) {
+            QSettings settings;
+            return settings.setValue(key, value);
+        }
+
+        sStore->change(key, value.isValid() ? value : QVariant(QString()));
+    }
+
+    void SettingsStore::remove(const QString& key)
+    {
+        if ( sStore == nullptr ) {
+            QSettings settings;
+            return settings.remove(key);
+        }
+
+        sStore->change(key, QVariant());
+    }
+
+    bool SettingsStore::contains(const QString& key)
+    {
+        QVariant result;
+        if ( sStore != nullptr && sStore->lookup(key, result) ) {
+            return result.isValid();
+        }
+
+        const QSettings settings;
+        return settings.contains(key);
+    }
+
+    const QStringList SettingsStore::keys(const QString& group)
+    {
+        QSettings settings;
+        settings.beginGroup(group);
+        QStringList result = settings.allKeys();
+        settings.endGroup();
+
+        if ( sStore != nullptr ) {
+            merge(sStore->fWriting, group + "/", result);
+            merge(sStore->fPending, group + "/", result);
+        }
+
+        return result;
+    }
+
+    void SettingsStore::flush()
+    {
+        if ( sStore == nullptr ) {
+            return;
+        }
+
+        sStore->fTimer.stop();
+        if ( sStore->fPending.isEmpty() && !sStore->fBusy ) {
+            return;
+        }
+
+        // queued behind any write in flight, so once this returns everything is on disk
+        const Changes changes = sStore->fPending;
+        sStore->fPending.clear();
+        QMetaObject::invokeMethod(&sStore->fWriter, [changes]() {
+            apply(changes);
+        }, Qt::BlockingQueuedConnection);
+    }
+
+    void SettingsStore::change(const QString& key, const QVariant& value)
+    {
+        fPending.insert(key, value);
+        if ( !fTimer.isActive() ) {
+            fTimer.start();
+        }
+    }
+
+    void SettingsStore::startWrite()
+    {
+        if ( fBusy || fPending.isEmpty() ) {
+            return;
+        }
+
+        fBusy = true;
+        fWriting = fPending;
+        fPending.clear();
+
+        const Changes changes = fWriting;
+        QMetaObject::invokeMethod(&fWriter, [this, changes]() {
+            apply(changes);
+            QMetaObject::invokeMethod(this, [this]() { writeDone(); }, Qt::QueuedConnection);
+        }, Qt::QueuedConnection);
+    }
+
+    void SettingsStore::writeDone()
+    {
+        fBusy = false;
+        fWriting.clear();
+
+        // more came in while we were writing
+        if ( !fPending.isEmpty() && !fTimer.isActive() ) {
+            fTimer.start();
+        }
+    }
+
+    bool SettingsStore::lookup(const QString& key, QVariant& result) const
+    {
+        Changes::const_iterator it = fPending.constFind(key);
+        if ( it != fPending.constEnd() ) {
+            result = it.value();
+            return true;
+        }
+
+        it = fWriting.constFind(key);
+        if ( it != fWriting.constEnd() ) {
+            result = it.value();
+            return true;
+        }
+
+        return false;
+    }
+
+    void SettingsStore::apply(const Changes& changes)
+    {
+        QSettings settings;
+        Changes::const_iterator it;
+        for ( it = changes.constBegin(); it != changes.constEnd(); ++it ) {
+            if ( it.value().isValid() ) {
+                settings.setValue(it.key(), it.value());
+            } else {
+                settings.remove(it.key());
+            }
+        }
+
+        settings.sync();
+        if ( settings.status() != QSettings::NoError ) {
+            EtherLog::logMsg("Unable to write settings, " + QString::number(changes.size()) + " changes lost", LS_Error);
+        }
+    }
+
+    void SettingsStore::merge(const Changes& changes, const QString& prefix, QStringList& keys)
+    {
+        Changes::const_iterator it = changes.lowerBound(prefix);
+        for ( ; it != changes.constEnd() && it.key().startsWith(prefix); ++it ) {
+            const QString key = it.key().mid(prefix.size());
+            if ( !it.value().isValid() ) {
+                keys.removeAll(key);
+            } else if ( !keys.contains(key) ) {
+                keys.append(key);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,52 @@
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QMap>
+#include <QVariant>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+namespace Etherwall {
+
+    // write-behind front for the model data kept in QSettings. Writes land in memory and are
+    // batched to disk on a background thread, reads see them right away. Everything is
+    // written out by flush() and on destruction. Falls back to plain QSettings if not created.
+    class SettingsStore : public QObject
+    {
+        Q_OBJECT
+    public:
+        SettingsStore();
+        virtual ~SettingsStore();
+
+        // keys are full QSettings paths e.g. "transactions/123_0"
+        static const QVariant value(const QString& key, const QVariant& defaultValue = QVariant());
+        static void setValue(const QString& key, const QVariant& value);
+        static void remove(const QString& key);
+        static bool contains(const QString& key);
+        static const QStringList keys(const QString& group);
+        static void flush();
+    private:
+        typedef QMap<QString, QVariant> Changes; // invalid value means removed
+
+        static SettingsStore* sStore;
+
+        Changes fPending; // not handed to the writer yet
+        Changes fWriting; // on the way to disk, still served to readers
+        bool fBusy;
+        QThread fThread;
+        QObject fWriter; // lives on fThread, queued writes run there in order
+        QTimer fTimer;
+
+        void change(const QString& key, const QVariant& value);
+        void startWrite();
+        void writeDone();
+        bool lookup(const QString& key, QVariant& result) const;
+        static void apply(const Changes& changes);
+        static void merge(const Changes& changes, const QString& prefix, QStringList& keys);
+    };
+
+}
+
+#endif // SETTINGSSTORE_H
@@ -0,0 +1,117 @@
+#include "startupscheduler.h"
+#include "etherlogapp.h"
+#include <QVariantMap>
+
+namespace Etherwall {
+
+    const int STARTUP_INTERACTIVE_TIMEOUT = 5000; // don't hold deferred stages forever if no frame shows up
+
+    StartupScheduler::Stage::Stage() : fName(), fPriority(Normal), fWork(), fQueued(0)
+    {
+    }
+
+    StartupScheduler::StartupScheduler() : QObject(nullptr),
+        fClock(), fQueue(), fStages(), fInteractive(-1), fTimer(), fFallbackTimer()
+    {
+        fClock.start();
+
+        fTimer.setSingleShot(true);
+        fTimer.setInterval(0);
+        connect(&fTimer, &QTimer::timeout, this, &StartupScheduler::runNext);
+
+        fFallbackTimer.setSingleShot(true);
+        fFallbackTimer.setInterval(STARTUP_INTERACTIVE_TIMEOUT);
+        connect(&fFallbackTimer, &QTimer::timeout, this, &StartupScheduler::markInteractive);
+        fFallbackTimer.start();
+    }
+
+    void StartupScheduler::schedule(const QString& name, Priority priority, const std::function<void()>& work)
+    {
+        Stage stage;
+        stage.fName = name;
+        stage.fPriority = priority;
+        stage.fWork = work;
+        stage.fQueued = fClock.elapsed();
+
+        int index = fQueue.size();
+        while ( index > 0 && fQueue.at(index - 1).fPriority > priority ) {
+            index--;
+        }
+        fQueue.insert(index, stage);
+
+        if ( runnable(stage) && !fTimer.isActive() ) {
+            fTimer.start();
+        }
+    }
+
+    bool StartupScheduler::getInteractive() const
+    {
+        return fInteractive >= 0;
+    }
+
+    int StartupScheduler::getTimeToInteractive() const
+    {
+        return (int)fInteractive;
+    }
+
+    const QVariantList StartupScheduler::getStages() const
+    {
+        return fStages;
+    }
+
+    void StartupScheduler::markInteractive()
+    {
+        // hooked to frameSwapped, only the first one counts
+        if ( sender() != nullptr && sender() != &fFallbackTimer ) {
+            disconnect(sender(), nullptr, this, nullptr);
+        }
+
+        if ( fInteractive >= 0 ) {
+            return;
+        }
+
+        fFallbackTimer.stop();
+        fInteractive = fClock.elapsed();
+        EtherLogApp::log(LS_Debug, [&]() { return "Interactive after " + QString::number(fInteractive) + "ms"; });
+        emit interactiveChanged();
+
+        if ( !fQueue.isEmpty() && !fTimer.isActive() ) {
+            fTimer.start();
+        }
+    }
+
+    void StartupScheduler::runNext()
+    {
+        if ( fQueue.isEmpty() || !runnable(fQueue.first()) ) {
+            return;
+        }
+
+        const Stage stage = fQueue.takeFirst();
+        const qint64 start = fClock.elapsed();
+        stage.fWork();
+        const qint64 end = fClock.elapsed();
+
+        QVariantMap timing;
+        timing.insert("name", stage.fName);
+        timing.insert("priority", (int)stage.fPriority);
+        timing.insert("waitMs", start - stage.fQueued);
+        timing.insert("durationMs", end - start);
+        timing.insert("finishedMs", end);
+        fStages.append(timing);
+        EtherLogApp::log(LS_Debug, [&]() {
+            return "Startup stage " + stage.fName + " took " + QString::number(end - start) + "ms after waiting " +
+                   QString::number(start - stage.fQueued) + "ms";
+        });
+        emit stagesChanged();
+
+        if ( !fQueue.isEmpty() && runnable(fQueue.first()) ) {
+            fTimer.start();
+        }
+    }
+
+    bool StartupScheduler::runnable(const Stage& stage) const
+    {
+        return stage.fPriority <= High || fInteractive >= 0;
+    }
+
+}
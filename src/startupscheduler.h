@@ -0,0 +1,64 @@
+#ifndef STARTUPSCHEDULER_H
+#define STARTUPSCHEDULER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariantList>
+#include <functional>
+
+namespace Etherwall {
+
+    // runs startup work in stages, one stage per event loop pass so the UI keeps painting in between.
+    // Critical and High stages run right away, Normal and Low ones wait until the first frame is up.
+    class StartupScheduler : public QObject
+    {
+        Q_OBJECT
+        Q_PROPERTY(bool interactive READ getInteractive NOTIFY interactiveChanged)
+        Q_PROPERTY(int timeToInteractive READ getTimeToInteractive NOTIFY interactiveChanged)
+        Q_PROPERTY(QVariantList stages READ getStages NOTIFY stagesChanged)
+    public:
+        enum Priority {
+            Critical = 0,
+            High,
+            Normal,
+            Low
+        };
+
+        StartupScheduler();
+
+        void schedule(const QString& name, Priority priority, const std::function<void()>& work);
+        bool getInteractive() const;
+        int getTimeToInteractive() const;
+        const QVariantList getStages() const;
+    public slots:
+        void markInteractive();
+    signals:
+        void interactiveChanged() const;
+        void stagesChanged() const;
+    private slots:
+        void runNext();
+    private:
+        struct Stage {
+            Stage();
+
+            QString fName;
+            Priority fPriority;
+            std::function<void()> fWork;
+            qint64 fQueued; // ms since startup
+        };
+
+        QElapsedTimer fClock;
+        QList<Stage> fQueue; // by priority, then in order scheduled
+        QVariantList fStages; // timings of finished stages
+        qint64 fInteractive;
+        QTimer fTimer;
+        QTimer fFallbackTimer;
+
+        bool runnable(const Stage& stage) const;
+    };
+
+}
+
+#endif // STARTUPSCHEDULER_H
@@ -0,0 +1,193 @@
+#include "statesnapshot.h"
+#include "accountmodel.h"
+#include "contractmodel.h"
+#include "transactionmodel.h"
+#include "etherlog.h"
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QJsonDocument>
+
+namespace Etherwall {
+
+    const quint32 STATE_SNAPSHOT_MAGIC = 0x45575353; // "EWSS"
+    const quint32 STATE_SNAPSHOT_VERSION = 1;
+    const int STATE_SNAPSHOT_TRANSACTIONS = 200; // most recent ones, the rest comes from settings later
+
+    StateSnapshot::StateSnapshot(NodeIPC& ipc) :
+        fIpc(ipc), fBlockNumber(0), fAccounts(), fContracts(), fTransactions()
+    {
+    }
+
+    bool StateSnapshot::load()
+    {
+        QFile file(fileName());
+        if ( !file.open(QIODevice::ReadOnly) || file.size() == 0 ) {
+            return false; // first run or nothing saved for this network
+        }
+
+        // map instead of reading so a large snapshot doesn't get copied up front
+        uchar* mapped = file.map(0, file.size());
+        const QByteArray data = mapped != nullptr ? QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), (int)file.size()) : file.readAll();
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        const bool result = read(stream);
+        if ( mapped != nullptr ) {
+            file.unmap(mapped);
+        }
+
+        if ( !result ) {
+            fBlockNumber = 0;
+            fAccounts.clear();
+            fContracts.clear();
+            fTransactions.clear();
+        }
+
+        return result;
+    }
+
+    void StateSnapshot::save(const AccountModel& accountModel, const ContractModel& contractModel, const TransactionModel& transactionModel) const
+    {
+        const QString path = fileName();
+        if ( !QDir().mkpath(QFileInfo(path).path()) ) {
+            EtherLog::logMsg("Unable to create snapshot directory for: " + path, LS_Error);
+            return;
+        }
+
+        QSaveFile file(path);
+        if ( !file.open(QIODevice::WriteOnly) ) {
+            EtherLog::logMsg("Unable to write state snapshot: " + path, LS_Error);
+            return;
+        }
+
+        QStringList tokens;
+        const ContractList& contracts = contractModel.getContracts();
+        foreach ( const ContractInfo& contract, contracts ) {
+            if ( contract.isERC20() ) {
+                tokens.append(contract.address());
+            }
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_6);
+        stream << STATE_SNAPSHOT_MAGIC << STATE_SNAPSHOT_VERSION << transactionModel.getBlockNumber();
+
+        const AccountList& accounts = accountModel.getAccounts();
+        stream << (quint32)accounts.size();
+        foreach ( const AccountInfo& info, accounts ) {
+            QMap<QString, QString> balances;
+            foreach ( const QString& token, tokens ) {
+                balances.insert(token, info.getTokenBalance(token));
+            }
+
+            stream << info.hash() << info.alias() << info.deviceID() << info.HDPath();
+            stream << info.value(BalanceRole).toString() << info.transactionCount() << balances;
+        }
+
+        stream << (quint32)contracts.size();
+        foreach ( const ContractInfo& contract, contracts ) {
+            stream << QJsonDocument(contract.toJson()).toJson(QJsonDocument::Compact);
+        }
+
+        const TransactionList& transactions = transactionModel.getTransactions();
+        QList<QByteArray> recent;
+        foreach ( const TransactionInfo& info, transactions ) {
+            if ( info.getBlockNumber() == 0 ) {
+                continue; // pending ones get re-checked from settings
+            }
+
+            recent.append(info.toJsonString().toUtf8());
+            if ( recent.size() >= STATE_SNAPSHOT_TRANSACTIONS ) {
+                break;
+            }
+        }
+        stream << (quint32)recent.size();
+        foreach ( const QByteArray& json, recent ) {
+            stream << json;
+        }
+
+        if ( stream.status() != QDataStream::Ok || !file.commit() ) {
+            EtherLog::logMsg("Unable to write state snapshot: " + path, LS_Error);
+        }
+    }
+
+    quint64 StateSnapshot::blockNumber() const
+    {
+        return fBlockNumber;
+    }
+
+    const AccountList& StateSnapshot::accounts() const
+    {
+        return fAccounts;
+    }
+
+    const ContractList& StateSnapshot::contracts() const
+    {
+        return fContracts;
+    }
+
+    const TransactionList& StateSnapshot::transactions() const
+    {
+        return fTransactions;
+    }
+
+    const QString StateSnapshot::fileName() const
+    {
+        const QString base = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        return QDir(base).filePath("snapshot" + fIpc.chainManager().networkPostfix() + ".dat");
+    }
+
+    bool StateSnapshot::read(QDataStream& stream)
+    {
+        quint32 magic = 0;
+        quint32 version = 0;
+        stream >> magic >> version >> fBlockNumber;
+
+        if ( magic != STATE_SNAPSHOT_MAGIC || version != STATE_SNAPSHOT_VERSION ) {
+            EtherLog::logMsg("Ignoring incompatible state snapshot: " + fileName(), LS_Warning);
+            return false;
+        }
+
+        quint32 count = 0;
+        stream >> count;
+        for ( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++ ) {
+            QString hash, alias, deviceID, hdPath, balance;
+            quint64 transCount = 0;
+            QMap<QString, QString> balances;
+            stream >> hash >> alias >> deviceID >> hdPath >> balance >> transCount >> balances;
+
+            AccountInfo info(hash, alias, deviceID, balance, transCount, hdPath, fIpc.chainManager().chainID());
+            QMap<QString, QString>::const_iterator it;
+            for ( it = balances.constBegin(); it != balances.constEnd(); ++it ) {
+                info.setTokenBalance(it.key(), it.value());
+            }
+            fAccounts.append(info);
+        }
+
+        stream >> count;
+        for ( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++ ) {
+            QByteArray json;
+            stream >> json;
+            fContracts.append(ContractInfo(QJsonDocument::fromJson(json).object()));
+        }
+
+        stream >> count;
+        for ( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++ ) {
+            QByteArray json;
+            stream >> json;
+            fTransactions.append(TransactionInfo(QJsonDocument::fromJson(json).object()));
+        }
+
+        if ( stream.status() != QDataStream::Ok ) {
+            EtherLog::logMsg("Corrupted state snapshot: " + fileName(), LS_Warning);
+            return false;
+        }
+
+        return true;
+    }
+
+}
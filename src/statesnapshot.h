@@ -0,0 +1,42 @@
+#ifndef STATESNAPSHOT_H
+#define STATESNAPSHOT_H
+
+#include <QString>
+#include "types.h"
+#include "nodeipc.h"
+#include "contractinfo.h"
+
+namespace Etherwall {
+
+    class AccountModel;
+    class ContractModel;
+    class TransactionModel;
+
+    // model state written on exit so the next launch can show it before the node answers,
+    // the models then reconcile against the node as usual. One file per network.
+    class StateSnapshot
+    {
+    public:
+        StateSnapshot(NodeIPC& ipc);
+
+        bool load();
+        void save(const AccountModel& accountModel, const ContractModel& contractModel, const TransactionModel& transactionModel) const;
+
+        quint64 blockNumber() const;
+        const AccountList& accounts() const;
+        const ContractList& contracts() const;
+        const TransactionList& transactions() const;
+    private:
+        NodeIPC& fIpc;
+        quint64 fBlockNumber;
+        AccountList fAccounts;
+        ContractList fContracts;
+        TransactionList fTransactions;
+
+        const QString fileName() const;
+        bool read(QDataStream& stream);
+    };
+
+}
+
+#endif // STATESNAPSHOT_H
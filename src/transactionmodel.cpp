@@ -19,7 +19,10 @@
  */
 
 #include "transactionmodel.h"
+#include "etherlogapp.h"
 #include "helpers.h"
+#include "rpcmetrics.h"
+#include "settingsstore.h"
 #include "ethereum/tx.h"
 #include <QDebug>
 #include <QTimer>
@@ -29,6 +32,7 @@
 #include <QJsonDocument>
 #include <QCoreApplication>
 #include <QSettings>
+#include <QSet>
 
 namespace Etherwall {
     const int ALWAYS_FAILING_TX_ERROR = -32000;
@@ -46,20 +50,27 @@ namespace Etherwall {
         return false; // otherwise leave as error
     }
 
-    TransactionModel::TransactionModel(NodeIPC& ipc, const AccountModel& accountModel, const QSslConfiguration& sslConfig) :
+    // requests that answer with sendTransactionDone
+    static bool isSendRequest(const QString& method)
+    {
+        return method == "eth_sendRawTransaction" || method == "personal_sendTransaction" || method == "personal_signAndSendTransaction";
+    }
+
+    TransactionModel::TransactionModel(NodeIPC& ipc, AccountModel& accountModel, const QSslConfiguration& sslConfig) :
         QAbstractTableModel(nullptr), fSSLConfig(sslConfig), fIpc(ipc), fAccountModel(accountModel),
         fBlockNumber(0), fLastBlock(0), fFirstBlock(0), fGasPrice("0"), fGasEstimate("0"), fNetManager(this),
-        fLatestVersion(QCoreApplication::applicationVersion())
+        fLatestVersion(QCoreApplication::applicationVersion()), fBatch(), fSending(), fSendActive(false), fChanges(*this), fDisplay(*this, 4)
     {
         ipc.registerIpcErrorHandler(ALWAYS_FAILING_TX_ERROR, &handleGasEstimateError);
 
         connect(&ipc, &NodeIPC::connectToServerDone, this, &TransactionModel::connectToServerDone);
-        connect(&ipc, &NodeIPC::getAccountsDone, this, &TransactionModel::getAccountsDone);
         connect(&ipc, &NodeIPC::getBlockNumberDone, this, &TransactionModel::getBlockNumberDone);
         connect(&ipc, &NodeIPC::getGasPriceDone, this, &TransactionModel::getGasPriceDone);
         connect(&ipc, &NodeIPC::estimateGasDone, this, &TransactionModel::estimateGasDone);
         connect(&ipc, &NodeIPC::sendTransactionDone, this, &TransactionModel::onSendTransactionDone);
         connect(&ipc, &NodeIPC::signTransactionDone, this, &TransactionModel::onSignTransactionDone);
+        connect(&ipc, &NodeIPC::requestChanged, this, &TransactionModel::onRequestChanged);
+        connect(&ipc, &NodeIPC::error, this, &TransactionModel::onRequestError);
         connect(&ipc, &NodeIPC::newTransaction, this, &TransactionModel::onNewTransaction);
         connect(&ipc, &NodeIPC::newBlock, this, &TransactionModel::newBlock);
         connect(&ipc, &NodeIPC::syncingChanged, this, &TransactionModel::syncingChanged);
@@ -127,24 +138,31 @@ namespace Etherwall {
         const int row = index.row();
 
         if ( role == Qt::DisplayRole ) {
-            switch (index.column()) {
-                case 0: return fTransactionList.at(row).getBlockNumber();
-                case 1: return fTransactionList.at(row).value(SenderAliasRole);
-                case 2: return fTransactionList.at(row).value(ReceiverAliasRole);
-                case 3: return fTransactionList.at(row).getValueFixed(2);
-                // case 4: return fTransactionList.at(row).value(DepthRole);
-            }
+            const TransactionInfo& info = fTransactionList.at(row);
+            return fDisplay.display(row, index.column(), [&]() -> QVariant {
+                switch (index.column()) {
+                    case 0: return info.getBlockNumber();
+                    case 1: return info.value(SenderAliasRole);
+                    case 2: return info.value(ReceiverAliasRole);
+                    case 3: return info.getValueFixed(2);
+                    // case 4: return info.value(DepthRole);
+                }
 
-            return "?";
+                return "?";
+            });
         }
 
-        // calculate distance from current block
+        // calculated against blockNumber, views that show it bind to that instead of waiting on a per row change
         if ( role == DepthRole ) {
             quint64 transBlockNum = fTransactionList.at(row).value(BlockNumberRole).toULongLong();
             if ( transBlockNum == 0 ) { // still pending
                 return -1;
             }
 
+            if ( transBlockNum > fBlockNumber ) {
+                return 0; // restored from a snapshot ahead of a node that's still catching up
+            }
+
             quint64 diff = fBlockNumber - transBlockNum;
             return diff;
         }
@@ -169,32 +187,30 @@ namespace Etherwall {
         fIpc.getGasPrice();
     }
 
-    void TransactionModel::getAccountsDone(const QStringList& list) {
-        Q_UNUSED(list);
-        refresh();
-        loadHistory();
+    const TransactionList& TransactionModel::getTransactions() const {
+        return fTransactionList;
+    }
+
+    void TransactionModel::restoreSnapshot(const TransactionList& transactions, quint64 blockNumber) {
+        beginResetModel();
+        fTransactionList = transactions;
+        endResetModel();
+
+        // only for display until the node answers, its first height replaces it even if lower
+        fBlockNumber = blockNumber;
+        emit blockNumberChanged(blockNumber);
     }
 
     void TransactionModel::getBlockNumberDone(quint64 num) {
-        if ( num <= fBlockNumber ) {
+        if ( fFirstBlock == 0 ) {
+            fFirstBlock = num; // first real height, whatever a snapshot said before doesn't count
+        } else if ( num <= fBlockNumber ) {
             return;
         }
 
         fBlockNumber = num;
-        if ( fFirstBlock == 0 ) {
-            fFirstBlock = num;
-        }
 
         emit blockNumberChanged(num);
-
-        if ( !fTransactionList.isEmpty() ) { // depth changed for all
-            const QModelIndex& leftIndex = QAbstractTableModel::createIndex(0, 5);
-            const QModelIndex& rightIndex = QAbstractTableModel::createIndex(fTransactionList.length() - 1, 5);
-            QVector<int> roles(2);
-            roles[0] = DepthRole;
-            roles[1] = Qt::DisplayRole;
-            emit dataChanged(leftIndex, rightIndex, roles);
-        }
     }
 
     void TransactionModel::getGasPriceDone(const QString& num) {
@@ -220,6 +236,7 @@ namespace Etherwall {
         if ( fIpc.isThinClient() ) {
             fIpc.signTransaction(tx, password);
         } else {
+            fSending.enqueue(-1);
             fIpc.sendTransaction(tx, password);
         }
     }
@@ -232,13 +249,222 @@ namespace Etherwall {
         fIpc.call(tx, index, userData);
     }
 
+    void TransactionModel::signBatch(const QVariantList& transactions)
+    {
+        if ( getBatchActive() ) {
+            emit error(tr("Batch signing already in progress"));
+            return;
+        }
+
+        fBatch.clear();
+        QMap<QString, quint64> nonces; // next free nonce per sender, consecutive within the batch
+
+        foreach ( const QVariant& val, transactions ) {
+            const QVariantMap map = val.toMap();
+            const QString from = map.value("from").toString().toLower();
+
+            BatchEntry entry;
+            entry.fFrom = from;
+            entry.fTo = map.value("to").toString();
+            entry.fValue = map.value("value").toString();
+            entry.fGas = map.value("gas").toString();
+            entry.fGasPrice = map.value("gasPrice").toString();
+            entry.fData = map.value("data").toString();
+            entry.fInfo.init(entry.fFrom, entry.fTo, entry.fValue, entry.fGas, entry.fGasPrice, entry.fData);
+            entry.fNonce = 0;
+            entry.fStatus = BatchQueued;
+
+            try {
+                const int accountIndex = fAccountModel.getAccountIndex(from);
+                entry.fHDPath = fAccountModel.getAccountHDPath(accountIndex);
+                entry.fDeviceID = fAccountModel.getAccountDeviceID(from);
+                if ( entry.fHDPath.isEmpty() ) {
+                    throw QString("Batch signing requires a TREZOR account");
+                }
+
+                if ( !nonces.contains(from) ) {
+                    nonces[from] = fAccountModel.getAccountNonce(accountIndex);
+                }
+                entry.fNonce = nonces[from]++;
+            } catch ( QString err ) {
+                entry.fStatus = BatchFailed;
+                entry.fError = err;
+            }
+
+            fBatch.append(entry);
+        }
+
+        EtherLog::logMsg("Batch signing " + QString::number(fBatch.size()) + " transactions");
+        emit batchChanged();
+        pumpBatch();
+    }
+
+    void TransactionModel::clearBatch()
+    {
+        if ( countBatch(BatchSigning) + countBatch(BatchSending) > 0 ) {
+            return; // signatures or send replies still coming back for these rows
+        }
+
+        fBatch.clear();
+        emit batchChanged();
+    }
+
+    bool TransactionModel::getBatchActive() const
+    {
+        return countBatch(BatchQueued) + countBatch(BatchSigning) + countBatch(BatchSigned) + countBatch(BatchSending) > 0;
+    }
+
+    int TransactionModel::getBatchSize() const
+    {
+        return fBatch.size();
+    }
+
+    double TransactionModel::getBatchProgress() const
+    {
+        if ( fBatch.isEmpty() ) {
+            return 0.0;
+        }
+
+        // signing and sending are each half the way, a failure finishes both
+        const int failed = countBatch(BatchFailed);
+        const int signedCount = countBatch(BatchSigned) + countBatch(BatchSending) + countBatch(BatchSent) + failed;
+        const int doneCount = countBatch(BatchSent) + failed;
+        return (signedCount + doneCount) / (2.0 * fBatch.size());
+    }
+
+    const QVariantList TransactionModel::getBatchStatus() const
+    {
+        static const char* statusNames[] = { "queued", "signing", "signed", "sending", "sent", "failed" };
+
+        QVariantList result;
+        foreach ( const BatchEntry& entry, fBatch ) {
+            QVariantMap map;
+            map["from"] = entry.fFrom;
+            map["to"] = entry.fTo;
+            map["value"] = entry.fValue;
+            map["nonce"] = entry.fNonce;
+            map["status"] = QString(statusNames[entry.fStatus]);
+            map["error"] = entry.fError;
+            map["hash"] = entry.fInfo.value(THashRole);
+            result.append(map);
+        }
+
+        return result;
+    }
+
+    void TransactionModel::onSignFailure(const QString& deviceID, const QString& error)
+    {
+        bool changed = false;
+        for ( int i = 0; i < fBatch.size(); i++ ) {
+            if ( fBatch.at(i).fStatus == BatchSigning && fBatch.at(i).fDeviceID == deviceID ) {
+                fBatch[i].fStatus = BatchFailed;
+                fBatch[i].fError = error;
+                changed = true;
+            }
+        }
+
+        if ( changed ) {
+            emit batchChanged();
+            pumpBatch();
+        }
+    }
+
+    void TransactionModel::pumpBatch()
+    {
+        // one signature in flight per device, different devices sign side by side
+        QSet<QString> busyDevices;
+        foreach ( const BatchEntry& entry, fBatch ) {
+            if ( entry.fStatus == BatchSigning ) {
+                busyDevices.insert(entry.fDeviceID);
+            }
+        }
+
+        const quint32 chainID = fIpc.chainManager().chainID();
+        for ( int i = 0; i < fBatch.size(); i++ ) {
+            BatchEntry& entry = fBatch[i];
+            if ( entry.fStatus != BatchQueued || busyDevices.contains(entry.fDeviceID) ) {
+                continue;
+            }
+
+            busyDevices.insert(entry.fDeviceID);
+            entry.fStatus = BatchSigning;
+            // reserved from the node's count, so this is lower than planned if an earlier entry failed and left a gap
+            entry.fNonce = fAccountModel.signTransaction(chainID, entry.fHDPath, entry.fFrom, entry.fTo, entry.fValue, entry.fNonce,
+                                                         entry.fGas, entry.fGasPrice, entry.fData);
+        }
+
+        if ( busyDevices.isEmpty() ) {
+            submitBatch();
+        }
+    }
+
+    void TransactionModel::submitBatch()
+    {
+        // everything is signed, so the raw transactions go out back to back
+        for ( int i = 0; i < fBatch.size(); i++ ) {
+            if ( fBatch.at(i).fStatus != BatchSigned ) {
+                continue;
+            }
+
+            fBatch[i].fStatus = BatchSending;
+            fSending.enqueue(i);
+            fIpc.sendRawTransaction(fBatch.at(i).fSigned);
+        }
+
+        emit batchChanged();
+        if ( countBatch(BatchSending) == 0 && !fBatch.isEmpty() ) {
+            emit batchDone(countBatch(BatchSent), countBatch(BatchFailed));
+        }
+    }
+
+    int TransactionModel::countBatch(BatchStatus status) const
+    {
+        int result = 0;
+        foreach ( const BatchEntry& entry, fBatch ) {
+            if ( entry.fStatus == status ) {
+                result++;
+            }
+        }
+
+        return result;
+    }
+
     void TransactionModel::onRawTransaction(const Ethereum::Tx& tx)
     {
+        const QString from = tx.fromStr().toLower();
+        for ( int i = 0; i < fBatch.size(); i++ ) {
+            if ( fBatch.at(i).fStatus == BatchSigning && fBatch.at(i).fFrom == from ) {
+                fBatch[i].fSigned = tx;
+                fBatch[i].fStatus = BatchSigned;
+                emit batchChanged();
+                pumpBatch();
+                return;
+            }
+        }
+
         fQueuedTransaction.init(tx.fromStr(), tx.toStr(), tx.valueStr(), tx.gasStr(), tx.gasPriceStr(), tx.dataStr());
+        fSending.enqueue(-1);
         fIpc.sendRawTransaction(tx);
     }
 
     void TransactionModel::onSendTransactionDone(const QString& hash) {
+        fSendActive = false;
+        const int row = fSending.isEmpty() ? -1 : fSending.dequeue();
+        if ( row >= 0 ) {
+            BatchEntry& entry = fBatch[row];
+            entry.fInfo.setHash(hash);
+            entry.fStatus = BatchSent;
+            addTransaction(entry.fInfo);
+            storeTransaction(entry.fInfo);
+            EtherLog::logMsg("Batch transaction sent, hash: " + hash);
+
+            emit batchChanged();
+            if ( countBatch(BatchSending) == 0 ) {
+                emit batchDone(countBatch(BatchSent), countBatch(BatchFailed));
+            }
+            return;
+        }
+
         fQueuedTransaction.setHash(hash);
         addTransaction(fQueuedTransaction);
         storeTransaction(fQueuedTransaction);
@@ -247,9 +473,54 @@ namespace Etherwall {
 
     void TransactionModel::onSignTransactionDone(const QString &hash)
     {
+        fSending.enqueue(-1);
         fIpc.sendRawTransaction(hash);
     }
 
+    void TransactionModel::onRequestChanged()
+    {
+        // emitted before the next request is written, so look once it's the active one
+        QMetaObject::invokeMethod(this, [this]() {
+            fSendActive = !fSending.isEmpty() && isSendRequest(fIpc.getActiveRequestName());
+        }, Qt::QueuedConnection);
+    }
+
+    void TransactionModel::onRequestError()
+    {
+        if ( fSending.isEmpty() ) {
+            return;
+        }
+
+        // the node rejected our send (no sendTransactionDone follows), or the connection
+        // went down and took every queued send with it. Other failures aren't ours.
+        const bool lost = fIpc.getConnectionState() == 0;
+        if ( !fSendActive && !lost ) {
+            return;
+        }
+
+        fSendActive = false;
+        int count = lost ? fSending.size() : 1;
+        bool changed = false;
+        while ( count-- > 0 ) {
+            const int row = fSending.dequeue();
+            if ( row < 0 ) {
+                continue; // single send, NodeIPC reported it already
+            }
+
+            fBatch[row].fStatus = BatchFailed;
+            fBatch[row].fError = lost ? tr("Connection to node lost") : tr("Rejected by node");
+            EtherLog::logMsg("Batch transaction failed to send: " + fBatch.at(row).fError, LS_Error);
+            changed = true;
+        }
+
+        if ( changed ) {
+            emit batchChanged();
+            if ( countBatch(BatchSending) == 0 ) {
+                emit batchDone(countBatch(BatchSent), countBatch(BatchFailed));
+            }
+        }
+    }
+
     void TransactionModel::onNewTransaction(const QJsonObject &json) {
         const TransactionInfo info(json);
         int ai1, ai2;
@@ -260,9 +531,7 @@ namespace Etherwall {
             const int n = containsTransaction(info.value(THashRole).toString());
             if ( n >= 0 ) { // ours
                 fTransactionList[n] = info;
-                const QModelIndex& leftIndex = QAbstractTableModel::createIndex(n, 0);
-                const QModelIndex& rightIndex = QAbstractTableModel::createIndex(n, 14);
-                emit dataChanged(leftIndex, rightIndex);
+                fChanges.rowChanged(n);
                 storeTransaction(fTransactionList.at(n));
             } else { // external from someone to us
                 addTransaction(info);
@@ -274,6 +543,7 @@ namespace Etherwall {
     }
 
     void TransactionModel::newBlock(const QJsonObject& block) {
+        RpcMetrics::Span span("TransactionModel::newBlock");
         const QJsonArray transactions = block.value("transactions").toArray();
         const quint64 blockNum = Helpers::toQUInt64(block.value("number"));
 
@@ -293,13 +563,11 @@ namespace Etherwall {
             const int n = containsTransaction(thash);
             if ( n >= 0 ) {
                 fTransactionList[n].init(to);
-                const QModelIndex& leftIndex = QAbstractTableModel::createIndex(n, 0);
-                const QModelIndex& rightIndex = QAbstractTableModel::createIndex(n, 14);
                 QVector<int> roles(3);
                 roles[0] = BlockNumberRole;
                 roles[1] = DepthRole;
                 roles[2] = Qt::DisplayRole;
-                emit dataChanged(leftIndex, rightIndex, roles);
+                fChanges.rowChanged(n, roles);
                 const TransactionInfo info = fTransactionList.at(n);
                 storeTransaction(fTransactionList.at(n));
                 emit confirmedTransaction(info.getSender(), info.getReceiver(), info.getHash());
@@ -346,10 +614,7 @@ namespace Etherwall {
     void TransactionModel::storeTransaction(const TransactionInfo& info) {
         // save to persistent memory for re-run
         const quint64 blockNum = info.value(BlockNumberRole).toULongLong();
-        QSettings settings;
-        settings.beginGroup("transactions");
-        settings.setValue(Helpers::toDecStr(blockNum) + "_" + info.value(TransactionIndexRole).toString(), info.toJsonString());
-        settings.endGroup();
+        SettingsStore::setValue("transactions/" + Helpers::toDecStr(blockNum) + "_" + info.value(TransactionIndexRole).toString(), info.toJsonString());
     }
 
     bool transCompare(const TransactionInfo& a, const TransactionInfo& b) {
@@ -358,12 +623,14 @@ namespace Etherwall {
 
     void TransactionModel::refresh()
     {
-        QSettings settings;
-        settings.beginGroup("transactions");
-        QStringList list = settings.allKeys();
+        RpcMetrics::Span span("TransactionModel::refresh");
+        const QStringList list = SettingsStore::keys("transactions");
+
+        // rebuilt from settings, replacing what the snapshot showed
+        TransactionList restored;
 
         foreach ( const QString bns, list ) {
-            const QString val = settings.value(bns, "bogus").toString();
+            const QString val = SettingsStore::value("transactions/" + bns, "bogus").toString();
             if ( val.contains("{") ) { // new format, get data and reload only recent transactions
                 QJsonParseError parseError;
                 const QJsonDocument jsonDoc = QJsonDocument::fromJson(val.toUtf8(), &parseError);
@@ -375,9 +642,9 @@ namespace Etherwall {
                     quint64 txBlockNum = Helpers::toQUInt64(json.value("blockNumber"));
 
                     if ( txBlockNum > 0 ) { // don't add "pending", we might have a failed leftover
-                        addTransaction(json);
+                        restored.append(TransactionInfo(json));
                     } else {
-                        settings.remove(bns);
+                        SettingsStore::remove("transactions/" + bns);
                     }
                     // if transaction is newer than 1 day restore it from geth anyhow to ensure correctness in case of reorg
                     if ( txBlockNum == 0 || fBlockNumber - txBlockNum < 5400 ) {
@@ -386,12 +653,22 @@ namespace Etherwall {
                 }
             } else if ( val != "bogus" ) { // old format, re-get and store full data
                 fIpc.getTransactionByHash(val);
-                settings.remove(bns);
+                SettingsStore::remove("transactions/" + bns);
             }
         }
-        settings.endGroup();
 
-        std::sort(fTransactionList.begin(), fTransactionList.end(), transCompare);
+        std::sort(restored.begin(), restored.end(), transCompare);
+
+        // pending ones aren't stored, keep them on top
+        for ( int i = fTransactionList.size() - 1; i >= 0; i-- ) {
+            if ( fTransactionList.at(i).getBlockNumber() == 0 ) {
+                restored.prepend(fTransactionList.at(i));
+            }
+        }
+
+        beginResetModel();
+        fTransactionList = restored;
+        endResetModel();
 
         lookupAccountsAliases();
     }
@@ -477,13 +754,10 @@ namespace Etherwall {
         }
 
         QVector<int> roles(3);
-        roles[0] = SenderRole;
-        roles[1] = ReceiverRole;
+        roles[0] = SenderAliasRole;
+        roles[1] = ReceiverAliasRole;
         roles[2] = Qt::DisplayRole;
-        const QModelIndex& leftIndex = QAbstractTableModel::createIndex(0, 0);
-        const QModelIndex& rightIndex = QAbstractTableModel::createIndex(fTransactionList.size(), 10);
-
-        emit dataChanged(leftIndex, rightIndex, roles);
+        fChanges.rowsChanged(0, fTransactionList.size() - 1, roles);
     }
 
     void TransactionModel::httpRequestDone(QNetworkReply *reply) {
@@ -507,7 +781,7 @@ namespace Etherwall {
         QJsonObject objectJson;
         const QByteArray data = QJsonDocument(objectJson).toJson();
 
-        EtherLog::logMsg("HTTP Post request: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post request: " + data; });
 
         fNetManager.post(request, data);
     }
@@ -554,7 +828,7 @@ namespace Etherwall {
         objectJson["accounts"] = fAccountModel.getAccountsJsonArray();
         const QByteArray data = QJsonDocument(objectJson).toJson();
 
-        EtherLog::logMsg("HTTP Post request: " + data, LS_Debug);
+        EtherLogApp::log(LS_Debug, [&]() { return "HTTP Post request: " + data; });
 
         fNetManager.post(request, data);
     }
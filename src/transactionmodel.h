@@ -27,10 +27,13 @@
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QQueue>
 #include "types.h"
 #include "nodeipc.h"
 #include "accountmodel.h"
 #include "etherlog.h"
+#include "changecoalescer.h"
+#include "rowcache.h"
 
 namespace Etherwall {
 
@@ -43,8 +46,12 @@ namespace Etherwall {
         Q_PROPERTY(QString gasPrice READ getGasPrice NOTIFY gasPriceChanged FINAL)
         Q_PROPERTY(QString gasEstimate READ getGasEstimate NOTIFY gasEstimateChanged FINAL)
         Q_PROPERTY(QString latestVersion READ getLatestVersion NOTIFY latestVersionChanged FINAL)
+        Q_PROPERTY(bool batchActive READ getBatchActive NOTIFY batchChanged)
+        Q_PROPERTY(int batchSize READ getBatchSize NOTIFY batchChanged)
+        Q_PROPERTY(double batchProgress READ getBatchProgress NOTIFY batchChanged)
+        Q_PROPERTY(QVariantList batchStatus READ getBatchStatus NOTIFY batchChanged)
     public:
-        TransactionModel(NodeIPC& ipc, const AccountModel& accountModel, const QSslConfiguration& sslConfig);
+        TransactionModel(NodeIPC& ipc, AccountModel& accountModel, const QSslConfiguration& sslConfig);
         quint64 getBlockNumber() const;
         const QString& getGasPrice() const;
         const QString& getLatestVersion() const;
@@ -54,11 +61,17 @@ namespace Etherwall {
         Q_INVOKABLE virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
         QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
         int containsTransaction(const QString& hash);
+        const TransactionList& getTransactions() const;
+        void restoreSnapshot(const TransactionList& transactions, quint64 blockNumber);
 
         Q_INVOKABLE void sendTransaction(const QString& password, const QString& from, const QString& to,
                              const QString& value, quint64 nonce, const QString& gas = QString(),
                              const QString& gasPrice = QString(), const QString& data = QString());
 
+        // list of {from, to, value, gas, gasPrice, data} maps from TREZOR accounts, nonces are assigned here
+        Q_INVOKABLE void signBatch(const QVariantList& transactions);
+        Q_INVOKABLE void clearBatch();
+
         Q_INVOKABLE void call(const QString& from, const QString& to,
                              const QString& value, const QString& gas,
                              const QString& gasPrice, const QString& data,
@@ -77,20 +90,26 @@ namespace Etherwall {
         double getHistoryProgress() const;
         quint64 getFirstBlock() const;
         quint64 getLastBlock() const;
+        bool getBatchActive() const;
+        int getBatchSize() const;
+        double getBatchProgress() const;
+        const QVariantList getBatchStatus() const;
     public slots:
         void onRawTransaction(const Ethereum::Tx& tx);
+        void onSignFailure(const QString& deviceID, const QString& error);
+        void refresh();
     private slots:
         void connectToServerDone();
-        void getAccountsDone(const QStringList& list);
         void getBlockNumberDone(quint64 num);
         void getGasPriceDone(const QString& num);
         void estimateGasDone(const QString& num);
         void onSendTransactionDone(const QString& hash);
         void onSignTransactionDone(const QString& hash);
+        void onRequestChanged();
+        void onRequestError();
         void onNewTransaction(const QJsonObject& json);
         void newBlock(const QJsonObject& block);
         void syncingChanged(bool syncing);
-        void refresh();
         void loadHistoryDone(QNetworkReply* reply);
         void checkVersionDone(QNetworkReply *reply);
         void httpRequestDone(QNetworkReply *reply);
@@ -104,10 +123,37 @@ namespace Etherwall {
         void latestVersionSame(const QString& version, bool manualVersionCheck) const;
         void receivedTransaction(const QString& toAddress) const;
         void confirmedTransaction(const QString& fromAddress, const QString& toAddress, const QString& hash) const;
+        void batchChanged() const;
+        void batchDone(int sent, int failed) const;
     private:
+        enum BatchStatus {
+            BatchQueued,
+            BatchSigning,
+            BatchSigned,
+            BatchSending,
+            BatchSent,
+            BatchFailed
+        };
+
+        struct BatchEntry {
+            QString fFrom;
+            QString fTo;
+            QString fValue;
+            QString fGas;
+            QString fGasPrice;
+            QString fData;
+            TransactionInfo fInfo; // what goes into the list once sent
+            QString fHDPath;
+            QString fDeviceID;
+            quint64 fNonce;
+            BatchStatus fStatus;
+            QString fError;
+            Ethereum::Tx fSigned;
+        };
+
         const QSslConfiguration fSSLConfig;
         NodeIPC& fIpc;
-        const AccountModel& fAccountModel;
+        AccountModel& fAccountModel;
         TransactionList fTransactionList;
         quint64 fBlockNumber;
         quint64 fLastBlock;
@@ -117,11 +163,19 @@ namespace Etherwall {
         TransactionInfo fQueuedTransaction;
         QNetworkAccessManager fNetManager;
         QString fLatestVersion;
+        QList<BatchEntry> fBatch;
+        QQueue<int> fSending; // batch rows, or -1 for fQueuedTransaction, waiting on sendTransactionDone in the node's order
+        bool fSendActive; // the request the node is working on is the head of fSending
+        ChangeCoalescer fChanges;
+        mutable RowCache fDisplay; // filled from data()
 
         int getInsertIndex(const TransactionInfo& info) const;
         void addTransaction(const TransactionInfo& info);
         void storeTransaction(const TransactionInfo& info);
         void refreshPendingTransactions();
+        void pumpBatch();
+        void submitBatch();
+        int countBatch(BatchStatus status) const;
     };
 
 }
@@ -0,0 +1,244 @@
+#include "devicepool.h"
+
+namespace Trezor {
+
+    DevicePool::DevicePool() : QObject(nullptr),
+        fDevices(), fCurrent(nullptr), fPrompting(nullptr)
+    {
+    }
+
+    DevicePool::~DevicePool()
+    {
+        qDeleteAll(fDevices); // each one joins its own worker
+    }
+
+    bool DevicePool::isPresent() const
+    {
+        foreach ( TrezorDevice* device, fDevices ) {
+            if ( device->isPresent() ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool DevicePool::isInitialized() const
+    {
+        foreach ( TrezorDevice* device, fDevices ) {
+            if ( device->isInitialized() ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool DevicePool::getBusy() const
+    {
+        foreach ( TrezorDevice* device, fDevices ) {
+            if ( device->getBusy() ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const QString DevicePool::getDeviceID() const
+    {
+        return fCurrent != nullptr ? fCurrent->getDeviceID() : QString();
+    }
+
+    const QString DevicePool::getVersion() const
+    {
+        return fCurrent != nullptr ? fCurrent->getVersion() : QString();
+    }
+
+    const QStringList DevicePool::getDeviceIDs() const
+    {
+        QStringList result;
+        foreach ( TrezorDevice* device, fDevices ) {
+            if ( device->isInitialized() ) {
+                result.append(device->getDeviceID());
+            }
+        }
+
+        return result;
+    }
+
+    bool DevicePool::isDeviceInitialized(const QString& deviceID) const
+    {
+        return findDevice(deviceID) != nullptr;
+    }
+
+    void DevicePool::getAddresses(const QString& deviceID, const QList<HDPath>& hdPaths)
+    {
+        TrezorDevice* device = deviceID.isEmpty() ? fCurrent : findDevice(deviceID);
+        if ( device == nullptr ) {
+            emit failure(tr("TREZOR device not connected") + " " + deviceID);
+            return;
+        }
+
+        device->getAddresses(hdPaths);
+    }
+
+    void DevicePool::signTransaction(const QString& deviceID, quint32 chaindID, const QString& hdPath, const QString& from, const QString& to,
+                                     const QString& valStr, quint64 nonce, const QString& gas, const QString& gasPrice, const QString& data)
+    {
+        TrezorDevice* device = deviceID.isEmpty() ? fCurrent : findDevice(deviceID);
+        if ( device == nullptr ) {
+            const QString err = tr("TREZOR device not connected") + " " + deviceID;
+            emit failure(err);
+            emit deviceFailure(deviceID, err);
+            return;
+        }
+
+        device->signTransaction(chaindID, hdPath, from, to, valStr, nonce, gas, gasPrice, data);
+    }
+
+    void DevicePool::cancel()
+    {
+        TrezorDevice* device = target();
+        fPrompting = nullptr;
+        if ( device != nullptr ) {
+            device->cancel();
+        }
+    }
+
+    void DevicePool::submitPin(const QString& pin)
+    {
+        TrezorDevice* device = target();
+        fPrompting = nullptr;
+        if ( device != nullptr ) {
+            device->submitPin(pin);
+        }
+    }
+
+    void DevicePool::submitPassphrase(const QString& pw)
+    {
+        TrezorDevice* device = target();
+        fPrompting = nullptr;
+        if ( device != nullptr ) {
+            device->submitPassphrase(pw);
+        }
+    }
+
+    void DevicePool::onDeviceInserted(const QString& path)
+    {
+        TrezorDevice* device = fDevices.value(path, nullptr);
+        if ( device == nullptr ) {
+            device = addDevice(path);
+        }
+
+        device->onDeviceInserted(path);
+    }
+
+    void DevicePool::onDeviceRemoved(const QString& path)
+    {
+        if ( path.isEmpty() ) { // platform can't tell which, the pathless device checks for itself
+            TrezorDevice* device = fDevices.value(path, nullptr);
+            if ( device != nullptr ) {
+                device->onDeviceRemoved(path);
+            }
+            return;
+        }
+
+        TrezorDevice* device = fDevices.take(path);
+        if ( device == nullptr ) {
+            return;
+        }
+
+        // the aborted request's completion never arrives (device is deleted), report it here with the ID it had
+        const QString deviceID = device->getDeviceID();
+        const bool busy = device->getBusy();
+        device->onDeviceRemoved(path); // aggregate signals fire with the device already out of the map
+        if ( busy ) {
+            const QString err = tr("TREZOR device removed") + " " + deviceID;
+            emit error(err);
+            emit deviceFailure(deviceID, err);
+        }
+
+        if ( fCurrent == device ) {
+            fCurrent = nullptr;
+        }
+        if ( fPrompting == device ) {
+            fPrompting = nullptr;
+        }
+
+        device->deleteLater();
+        emit busyChanged(getBusy());
+    }
+
+    TrezorDevice* DevicePool::addDevice(const QString& path)
+    {
+        TrezorDevice* device = new TrezorDevice();
+        fDevices.insert(path, device);
+
+        connect(device, &TrezorDevice::presenceChanged, this, [this]() {
+            emit presenceChanged(isPresent());
+        });
+        connect(device, &TrezorDevice::initialized, this, [this, device](const QString& deviceID) {
+            fCurrent = device;
+            emit initialized(deviceID);
+        });
+        connect(device, &TrezorDevice::initializedChanged, this, [this, device](bool initialized) {
+            if ( !initialized && fCurrent == device ) {
+                fCurrent = nullptr;
+                foreach ( TrezorDevice* other, fDevices ) {
+                    if ( other != device && other->isInitialized() ) {
+                        fCurrent = other;
+                        break;
+                    }
+                }
+            }
+            emit initializedChanged(isInitialized());
+        });
+        connect(device, &TrezorDevice::matrixRequest, this, [this, device](int type) {
+            fPrompting = device;
+            emit matrixRequest(type);
+        });
+        connect(device, &TrezorDevice::passphraseRequest, this, [this, device](bool onDevice) {
+            if ( !onDevice ) {
+                fPrompting = device;
+            }
+            emit passphraseRequest(onDevice);
+        });
+        connect(device, &TrezorDevice::addressRetrieved, this, [this, device](const QString& address, const QString& hdPath) {
+            emit addressRetrieved(address, hdPath, device->getDeviceID());
+        });
+        connect(device, &TrezorDevice::busyChanged, this, [this]() {
+            emit busyChanged(getBusy());
+        });
+        connect(device, &TrezorDevice::failure, this, [this, device](const QString& err) {
+            emit failure(err);
+            emit deviceFailure(device->getDeviceID(), err);
+        });
+        connect(device, &TrezorDevice::error, this, [this, device](const QString& err) {
+            emit error(err);
+            emit deviceFailure(device->getDeviceID(), err);
+        });
+        connect(device, &TrezorDevice::buttonRequest, this, &DevicePool::buttonRequest);
+        connect(device, &TrezorDevice::transactionReady, this, &DevicePool::transactionReady);
+        connect(device, &TrezorDevice::deviceOutdated, this, &DevicePool::deviceOutdated);
+
+        return device;
+    }
+
+    TrezorDevice* DevicePool::findDevice(const QString& deviceID) const
+    {
+        foreach ( TrezorDevice* device, fDevices ) {
+            if ( device->isInitialized() && device->getDeviceID() == deviceID ) {
+                return device;
+            }
+        }
+
+        return nullptr;
+    }
+
+    TrezorDevice* DevicePool::target() const
+    {
+        return fPrompting != nullptr ? fPrompting : fCurrent;
+    }
+
+}
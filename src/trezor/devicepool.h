@@ -0,0 +1,69 @@
+#ifndef DEVICEPOOL_H
+#define DEVICEPOOL_H
+
+#include <QObject>
+#include <QMap>
+#include <QStringList>
+#include "trezor.h"
+
+namespace Trezor {
+
+    // one TrezorDevice (and so one I/O thread) per connected TREZOR, requests for different devices
+    // run side by side. The GUI sees the pool as a single device, user prompts are answered by whichever
+    // device asked for them and signing is routed by deviceID.
+    class DevicePool: public QObject
+    {
+        Q_OBJECT
+        Q_PROPERTY(QString deviceID READ getDeviceID NOTIFY initialized)
+        Q_PROPERTY(QString version READ getVersion NOTIFY initialized)
+        Q_PROPERTY(bool present READ isPresent NOTIFY presenceChanged)
+        Q_PROPERTY(bool initialized READ isInitialized NOTIFY initializedChanged)
+        Q_PROPERTY(bool busy READ getBusy NOTIFY busyChanged)
+        Q_PROPERTY(QStringList deviceIDs READ getDeviceIDs NOTIFY initializedChanged)
+    public:
+        explicit DevicePool();
+        virtual ~DevicePool();
+
+        bool isPresent() const;
+        bool isInitialized() const;
+        bool getBusy() const;
+        const QString getDeviceID() const;
+        const QString getVersion() const;
+        const QStringList getDeviceIDs() const;
+        Q_INVOKABLE bool isDeviceInitialized(const QString& deviceID) const;
+        void getAddresses(const QString& deviceID, const QList<HDPath>& hdPaths);
+        void signTransaction(const QString& deviceID, quint32 chaindID, const QString& hdPath, const QString& from, const QString& to,
+                             const QString& valStr, quint64 nonce, const QString& gas, const QString& gasPrice, const QString& data);
+        Q_INVOKABLE void cancel();
+        Q_INVOKABLE void submitPin(const QString& pin);
+        Q_INVOKABLE void submitPassphrase(const QString& pw);
+    signals:
+        void presenceChanged(bool present) const;
+        void initialized(const QString& deviceID) const;
+        void initializedChanged(bool initialized) const;
+        void failure(const QString& error) const;
+        void matrixRequest(int type) const;
+        void buttonRequest(int code) const;
+        void passphraseRequest(bool onDevice) const;
+        void addressRetrieved(const QString& address, const QString& hdPath, const QString& deviceID) const;
+        void busyChanged(bool busy) const;
+        void transactionReady(const Ethereum::Tx& tx) const;
+        void deviceOutdated(const QString& minVersion, const QString& curVersion) const;
+        void error(const QString& error) const;
+        void deviceFailure(const QString& deviceID, const QString& error) const; // failure or error, with who had it
+    public slots:
+        void onDeviceInserted(const QString& path);
+        void onDeviceRemoved(const QString& path);
+    private:
+        QMap<QString, TrezorDevice*> fDevices; // by device node, empty key for the one that looks for itself
+        TrezorDevice* fCurrent; // last one initialized, what the GUI shows
+        TrezorDevice* fPrompting; // waiting on PIN/passphrase typed on the host
+
+        TrezorDevice* addDevice(const QString& path);
+        TrezorDevice* findDevice(const QString& deviceID) const;
+        TrezorDevice* target() const;
+    };
+
+}
+
+#endif // DEVICEPOOL_H
@@ -0,0 +1,284 @@
+#include "emulator.h"
+#include <QStringList>
+
+namespace Trezor {
+
+    Emulator::Emulator(const QString& script) :
+        fMutex(), fReadable(), fInput(), fOutput(), fInitialized(false), fAborted(false),
+        fScriptPin(false), fScriptButton(false), fUnlocked(false), fAwaitingButton(false),
+        fParkedID(0), fParkedPayload(), fChainID(0), fDataRemaining(0), fTxHash(QCryptographicHash::Sha256)
+    {
+        const QStringList steps = script.toLower().split(',', Qt::SkipEmptyParts);
+        fScriptPin = steps.contains("pin");
+        fScriptButton = steps.contains("button");
+    }
+
+    void Emulator::init()
+    {
+        QMutexLocker locker(&fMutex);
+        fInput.clear();
+        fOutput.clear();
+        fInitialized = true;
+        fAborted = false;
+        fUnlocked = !fScriptPin;
+        fAwaitingButton = false;
+        fParkedID = 0;
+    }
+
+    bool Emulator::isInitialized() const
+    {
+        QMutexLocker locker(&fMutex);
+        return fInitialized;
+    }
+
+    void Emulator::close()
+    {
+        QMutexLocker locker(&fMutex);
+        fInitialized = false;
+    }
+
+    bool Emulator::isPresent()
+    {
+        return true; // always plugged in
+    }
+
+    void Emulator::setDevicePath(const QString& path)
+    {
+        Q_UNUSED(path)
+    }
+
+    void Emulator::read_buffered(char_type *data, size_t len)
+    {
+        QMutexLocker locker(&fMutex);
+        while ( fOutput.size() < len ) {
+            if ( fAborted ) {
+                throw wire_error("Emulator read aborted");
+            }
+            fReadable.wait(&fMutex, 50);
+        }
+
+        std::copy(fOutput.begin(), fOutput.begin() + len, data);
+        fOutput.erase(fOutput.begin(), fOutput.begin() + len);
+    }
+
+    void Emulator::write(char_type const *data, size_t len)
+    {
+        write(nullptr, 0, data, len);
+    }
+
+    void Emulator::write(char_type const *head, size_t head_len, char_type const *data, size_t len)
+    {
+        QMutexLocker locker(&fMutex);
+        if ( !fInitialized ) {
+            throw wire_error("Write called on closed emulator");
+        }
+
+        fInput.insert(fInput.end(), head, head + head_len);
+        fInput.insert(fInput.end(), data, data + len);
+        processInput();
+        fReadable.wakeAll();
+    }
+
+    void Emulator::abort()
+    {
+        QMutexLocker locker(&fMutex);
+        fAborted = true;
+        fReadable.wakeAll();
+    }
+
+    void Emulator::clear_abort()
+    {
+        QMutexLocker locker(&fMutex);
+        fAborted = false;
+    }
+
+    void Emulator::processInput()
+    {
+        // "##" + id(2) + size(4) + payload, both big endian
+        while ( fInput.size() >= 8 ) {
+            if ( fInput[0] != '#' || fInput[1] != '#' ) {
+                fInput.clear();
+                throw wire_error("Emulator got malformed header");
+            }
+
+            const quint16 id = (fInput[2] << 8) | fInput[3];
+            const quint32 size = (fInput[4] << 24) | (fInput[5] << 16) | (fInput[6] << 8) | fInput[7];
+            if ( fInput.size() < 8 + size ) {
+                return; // wait for the rest
+            }
+
+            const std::string payload(fInput.begin() + 8, fInput.begin() + 8 + size);
+            fInput.erase(fInput.begin(), fInput.begin() + 8 + size);
+            handleRequest(id, payload);
+        }
+    }
+
+    void Emulator::handleRequest(quint16 id, const std::string& payload)
+    {
+        switch ( id ) {
+            case MessageType_Initialize: {
+                fAwaitingButton = false;
+                fParkedID = 0;
+
+                Features response;
+                response.set_vendor("etherwall emulator");
+                response.set_device_id("EMULATOR");
+                response.set_major_version(1);
+                response.set_minor_version(9);
+                response.set_patch_version(0);
+                return reply(response, MessageType_Features);
+            }
+            case MessageType_Cancel: {
+                fAwaitingButton = false;
+                fParkedID = 0;
+                return fail(Failure::Failure_ActionCancelled, "Cancelled");
+            }
+            case MessageType_PinMatrixAck: {
+                PinMatrixAck request;
+                if ( !request.ParseFromString(payload) || request.pin().empty() ) {
+                    return fail(Failure::Failure_PinInvalid, "Invalid PIN");
+                }
+
+                fUnlocked = true;
+                if ( fParkedID > 0 ) {
+                    const quint16 parkedID = fParkedID;
+                    fParkedID = 0;
+                    handleRequest(parkedID, fParkedPayload);
+                }
+                return;
+            }
+            case MessageType_ButtonAck: {
+                if ( !fAwaitingButton ) {
+                    return fail(Failure::Failure_UnexpectedMessage, "Unexpected ButtonAck");
+                }
+
+                fAwaitingButton = false;
+                return continueSignTx();
+            }
+            case MessageType_EthereumGetAddress: {
+                if ( needsPin(id, payload) ) {
+                    return;
+                }
+                return handleGetAddress(payload);
+            }
+            case MessageType_EthereumSignTx: {
+                if ( needsPin(id, payload) ) {
+                    return;
+                }
+                return handleSignTx(payload);
+            }
+            case MessageType_EthereumTxAck: {
+                EthereumTxAck request;
+                if ( !request.ParseFromString(payload) || request.data_chunk().size() > fDataRemaining ) {
+                    return fail(Failure::Failure_DataError, "Invalid data chunk");
+                }
+
+                fTxHash.addData(request.data_chunk().data(), request.data_chunk().size());
+                fDataRemaining -= request.data_chunk().size();
+                return continueSignTx();
+            }
+        }
+
+        fail(Failure::Failure_UnexpectedMessage, "Unexpected message");
+    }
+
+    void Emulator::handleGetAddress(const std::string& payload)
+    {
+        EthereumGetAddress request;
+        if ( !request.ParseFromString(payload) ) {
+            return fail(Failure::Failure_DataError, "Invalid GetAddress");
+        }
+
+        // stable fake address per path
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        for ( int i = 0; i < request.address_n_size(); i++ ) {
+            const quint32 segment = request.address_n(i);
+            hash.addData(reinterpret_cast<const char*>(&segment), sizeof(segment));
+        }
+
+        EthereumAddress response;
+        response.set_address(hash.result().left(20).toStdString());
+        reply(response, MessageType_EthereumAddress);
+    }
+
+    void Emulator::handleSignTx(const std::string& payload)
+    {
+        EthereumSignTx request;
+        if ( !request.ParseFromString(payload) ) {
+            return fail(Failure::Failure_DataError, "Invalid SignTx");
+        }
+
+        if ( request.data_initial_chunk().size() > request.data_length() ) {
+            return fail(Failure::Failure_DataError, "Initial chunk bigger than data length");
+        }
+
+        fChainID = request.chain_id();
+        fDataRemaining = request.data_length() - request.data_initial_chunk().size();
+        fTxHash.reset();
+        fTxHash.addData(payload.data(), payload.size());
+
+        if ( fScriptButton ) {
+            fAwaitingButton = true;
+            ButtonRequest response;
+            response.set_code(ButtonRequest::ButtonRequest_SignTx);
+            return reply(response, MessageType_ButtonRequest);
+        }
+
+        continueSignTx();
+    }
+
+    void Emulator::continueSignTx()
+    {
+        EthereumTxRequest response;
+        if ( fDataRemaining > 0 ) { // ask for the rest of the data in chunks like the device does
+            response.set_data_length(qMin(fDataRemaining, (quint32)1024));
+            return reply(response, MessageType_EthereumTxRequest);
+        }
+
+        const QByteArray r = fTxHash.result();
+        const QByteArray s = QCryptographicHash::hash(r, QCryptographicHash::Sha256);
+        response.set_signature_v(fChainID > 0 ? fChainID * 2 + 35 : 27);
+        response.set_signature_r(r.toStdString());
+        response.set_signature_s(s.toStdString());
+        reply(response, MessageType_EthereumTxRequest);
+    }
+
+    bool Emulator::needsPin(quint16 id, const std::string& payload)
+    {
+        if ( fUnlocked ) {
+            return false;
+        }
+
+        fParkedID = id;
+        fParkedPayload = payload;
+        PinMatrixRequest response;
+        response.set_type(PinMatrixRequest::PinMatrixRequestType_Current);
+        reply(response, MessageType_PinMatrixRequest);
+
+        return true;
+    }
+
+    void Emulator::fail(int code, const std::string& message)
+    {
+        Failure response;
+        response.set_code(static_cast<Failure::FailureType>(code));
+        response.set_message(message);
+        reply(response, MessageType_Failure);
+    }
+
+    void Emulator::reply(const google::protobuf::Message& msg, MessageType type)
+    {
+        const std::string payload = msg.SerializeAsString();
+        const quint32 size = payload.size();
+        const char_type header[8] = {
+            '#', '#',
+            static_cast<char_type>((type >> 8) & 0xFF), static_cast<char_type>(type & 0xFF),
+            static_cast<char_type>((size >> 24) & 0xFF), static_cast<char_type>((size >> 16) & 0xFF),
+            static_cast<char_type>((size >> 8) & 0xFF), static_cast<char_type>(size & 0xFF)
+        };
+
+        fOutput.insert(fOutput.end(), header, header + 8);
+        fOutput.insert(fOutput.end(), payload.begin(), payload.end());
+    }
+
+}
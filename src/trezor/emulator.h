@@ -0,0 +1,62 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCryptographicHash>
+#include <deque>
+#include "trezor.h"
+
+namespace Trezor {
+
+    // in-process stand-in for a TREZOR speaking the framed protobuf protocol, lets the whole
+    // signing path run without hardware. Script is a comma separated list of prompts to simulate:
+    // "pin" asks for a PIN before the first address/sign request, "button" asks to confirm signing.
+    // Signatures are deterministic placeholders and will not verify on chain.
+    class Emulator: public Wire::Transport
+    {
+    public:
+        Emulator(const QString& script);
+
+        virtual void init();
+        virtual bool isInitialized() const;
+        virtual void close();
+        virtual bool isPresent();
+        virtual void setDevicePath(const QString& path);
+
+        virtual void read_buffered(char_type *data, size_t len);
+        virtual void write(char_type const *data, size_t len);
+        virtual void write(char_type const *head, size_t head_len, char_type const *data, size_t len);
+        virtual void abort();
+        virtual void clear_abort();
+    private:
+        mutable QMutex fMutex;
+        QWaitCondition fReadable;
+        std::vector<char_type> fInput; // request bytes until a whole frame is in
+        std::deque<char_type> fOutput; // framed replies waiting to be read
+        bool fInitialized;
+        bool fAborted;
+
+        bool fScriptPin;
+        bool fScriptButton;
+        bool fUnlocked;
+        bool fAwaitingButton;
+        quint16 fParkedID; // request waiting behind a PIN prompt
+        std::string fParkedPayload;
+        quint32 fChainID;
+        quint32 fDataRemaining;
+        QCryptographicHash fTxHash;
+
+        void processInput();
+        void handleRequest(quint16 id, const std::string& payload);
+        void handleGetAddress(const std::string& payload);
+        void handleSignTx(const std::string& payload);
+        void continueSignTx();
+        bool needsPin(quint16 id, const std::string& payload);
+        void fail(int code, const std::string& message);
+        void reply(const google::protobuf::Message& msg, MessageType type);
+    };
+
+}
+
+#endif // EMULATOR_H
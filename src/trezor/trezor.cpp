@@ -1,4 +1,5 @@
 #include "trezor.h"
+#include "emulator.h"
 #include "helpers.h"
 #include "ethereum/tx.h"
 #include <QDebug>
@@ -6,10 +7,36 @@
 
 namespace Trezor {
 
+    static Wire::Transport* createTransport()
+    {
+        // e.g. ETHERWALL_TREZOR_EMULATOR=pin,button to run against the in-process emulator
+        if ( qEnvironmentVariableIsSet("ETHERWALL_TREZOR_EMULATOR") ) {
+            return new Emulator(QString::fromUtf8(qgetenv("ETHERWALL_TREZOR_EMULATOR")));
+        }
+
+        return new Wire::Device();
+    }
+
+    static const Wire::Message toWire(const google::protobuf::Message& msg, MessageType type, const QVariant& index)
+    {
+        Wire::Message msg_wire;
+        msg_wire.id = type;
+        msg_wire.index = index;
+        const size_t size = msg.ByteSizeLong();
+        msg_wire.data.resize(size);
+        if ( !msg.SerializeToArray(msg_wire.data.data(), size) ) {
+            throw QString("Could not serialize msg: " + QString::number(type));
+        }
+
+        return msg_wire;
+    }
+
     TrezorDevice::TrezorDevice() : QObject(nullptr),
-        fDevice(), fWorker(fDevice), fQueue(), fDeviceID(), fDevicePresent(false)
+        fTransport(createTransport()), fDevice(*fTransport), fWorker(fDevice), fDeviceID(), fDevicePresent(false), fDevicePath(),
+        fPendingTx(), fSignQueue(), fSigning(false)
     {
-        connect(&fWorker, &TrezorWorker::finished, this, &TrezorDevice::workerDone);
+        connect(&fWorker, &TrezorWorker::completed, this, &TrezorDevice::workerDone, Qt::QueuedConnection);
+        fWorker.start();
     }
 
     TrezorDevice::~TrezorDevice()
@@ -23,21 +50,33 @@ namespace Trezor {
             return;
         }
 
-        bool wasPresent = fDevicePresent;
-        fDevicePresent = fDevice.isPresent();
+        setPresent(fDevice.isPresent());
+    }
+
+    void TrezorDevice::setPresent(bool present)
+    {
+        if ( present == fDevicePresent ) {
+            return;
+        }
 
-        if ( wasPresent != fDevicePresent ) {
-            emit presenceChanged(fDevicePresent);
+        fDevicePresent = present;
+        emit presenceChanged(fDevicePresent);
 
-            // we if inserted
-            if ( fDevicePresent ) {
-                initialize();
-            } else { // if we removed
-                fDeviceID = QString();
-                fDevice.close();
-                emit initializedChanged(false);
-            }
+        // we if inserted
+        if ( fDevicePresent ) {
+            initialize();
+            return;
         }
+
+        // if we removed, abort whatever was in flight instead of waiting on a gone device,
+        // its completion is dropped so whoever removed us reports the failure
+        fWorker.abort();
+        stopSigning();
+        fDeviceID = QString();
+        if ( !getBusy() ) {
+            fDevice.close();
+        } // otherwise closed in workerDone once the transfer gave up
+        emit initializedChanged(false);
     }
 
     bool TrezorDevice::isPresent()
@@ -66,14 +105,31 @@ namespace Trezor {
         sendMessage(request, MessageType_Initialize);
     }
 
-    void TrezorDevice::onDeviceInserted()
+    void TrezorDevice::onDeviceInserted(const QString& path)
     {
-        checkPresence();
+        // platform can't tell which device it was, look for ourselves
+        if ( path.isEmpty() ) {
+            return checkPresence();
+        }
+
+        fDevicePath = path;
+        fDevice.setDevicePath(path);
+        setPresent(true);
     }
 
-    void TrezorDevice::onDeviceRemoved()
+    void TrezorDevice::onDeviceRemoved(const QString& path)
     {
-        checkPresence();
+        if ( path.isEmpty() ) {
+            return checkPresence();
+        }
+
+        if ( path != fDevicePath ) {
+            return; // not the one we have open
+        }
+
+        fDevicePath = QString();
+        fDevice.setDevicePath(QString());
+        setPresent(false);
     }
 
     void TrezorDevice::onDirectoryChanged(const QString &path)
@@ -83,18 +139,44 @@ namespace Trezor {
     }
 
     void TrezorDevice::getAddress(const HDPath& hdPath)
+    {
+        EthereumGetAddress request;
+        if ( !buildGetAddress(hdPath, request) ) {
+            return;
+        }
+
+        sendMessage(request, MessageType_EthereumGetAddress, hdPath.toString());        
+    }
+
+    void TrezorDevice::getAddresses(const QList<HDPath>& hdPaths)
+    {
+        // all go in at once, the worker holds the rest back while a PIN/passphrase prompt is pending
+        QList<Wire::Message> requests;
+        foreach ( const HDPath& hdPath, hdPaths ) {
+            EthereumGetAddress request;
+            if ( !buildGetAddress(hdPath, request) ) {
+                return;
+            }
+
+            requests.append(serializeMessage(request, MessageType_EthereumGetAddress, hdPath.toString()));
+        }
+
+        fWorker.post(requests);
+        emit busyChanged(getBusy());
+    }
+
+    bool TrezorDevice::buildGetAddress(const HDPath& hdPath, EthereumGetAddress& request)
     {
         if ( !isPresent() ) {
             bail("getAddress called when trezor not present");
-            return;
+            return false;
         }
 
         if ( !hdPath.valid() ) {
             bail("hd path invalid");
-            return;
+            return false;
         }
 
-        EthereumGetAddress request;
         request.set_show_display(false);
 
         quint32 segment;
@@ -103,7 +185,7 @@ namespace Trezor {
             request.add_address_n(segment);
         }
 
-        sendMessage(request, MessageType_EthereumGetAddress, hdPath.toString());        
+        return true;
     }
 
     const QString TrezorDevice::getDeviceID() const
@@ -133,80 +215,132 @@ namespace Trezor {
     void TrezorDevice::signTransaction(quint32 chaindID, const QString& hdPath, const QString& from, const QString &to, const QString &valStr,
                                        quint64 nonce, const QString &gas, const QString &gasPrice, const QString &data)
     {
-        fPendingTx.init(from, to, valStr, nonce, gas, gasPrice, data);
+        SignRequest sign;
+        sign.fChainID = chaindID;
+        sign.fHDPath = hdPath;
+        sign.fFrom = from;
+        sign.fTo = to;
+        sign.fValue = valStr;
+        sign.fNonce = nonce;
+        sign.fGas = gas;
+        sign.fGasPrice = gasPrice;
+        sign.fData = data;
+        fSignQueue.enqueue(sign);
+
+        // fPendingTx belongs to the signature in flight until it comes back
+        if ( !fSigning ) {
+            startSigning();
+        }
+    }
+
+    void TrezorDevice::startSigning()
+    {
+        if ( fSignQueue.isEmpty() ) {
+            return;
+        }
+
+        const SignRequest sign = fSignQueue.dequeue();
+        fSigning = true;
+        fPendingTx.init(sign.fFrom, sign.fTo, sign.fValue, sign.fNonce, sign.fGas, sign.fGasPrice, sign.fData);
 
         EthereumSignTx request;
 
-        HDPath path(hdPath);
+        HDPath path(sign.fHDPath);
         quint32 segment;
         int index = 0;
         while ( path.getSegment(index++, segment) ) {
             request.add_address_n(segment);
         }
 
-        request.set_chain_id(chaindID);
+        request.set_chain_id(sign.fChainID);
         request.set_to(fPendingTx.toStr().toStdString());
         if ( fPendingTx.hasValue() ) {
             request.set_value(fPendingTx.valueBytes());
         }
-        if ( nonce > 0 ) { // seems like a protobuf/trezor bug
+        if ( sign.fNonce > 0 ) { // seems like a protobuf/trezor bug
             request.set_nonce(fPendingTx.nonceBytes());
         }
         request.set_gas_limit(fPendingTx.gasBytes());
         request.set_gas_price(fPendingTx.gasPriceBytes());
 
-        if ( fPendingTx.dataByteSize() > 0 ) {
-            request.set_data_length(fPendingTx.dataByteSize());
+        const quint32 dataSize = fPendingTx.dataByteSize();
+        if ( dataSize > 0 ) {
+            request.set_data_length(dataSize);
             request.set_data_initial_chunk(fPendingTx.dataNext(1024));
         }
 
-        sendMessage(request, MessageType_EthereumSignTx);
+        // the worker streams its own copy of the rest, nothing of fPendingTx is shared with it
+        Wire::Message msg = serializeMessage(request, MessageType_EthereumSignTx, QVariant());
+        if ( dataSize > 1024 ) {
+            msg.stream_data = fPendingTx.dataNext(dataSize - 1024);
+        }
+
+        fWorker.post(msg);
+        emit busyChanged(getBusy());
+    }
+
+    void TrezorDevice::stopSigning()
+    {
+        // the worker dropped its queue, so did the signatures waiting behind the failed one
+        fSigning = false;
+        fSignQueue.clear();
     }
 
     void TrezorDevice::workerDone()
     {
-        handleResponse(fWorker.getReply()); // handle first so we can have "inserts" for the meta workflows
-        sendNext();
+        TrezorWorker::Completion completion;
+        while ( fWorker.takeCompletion(completion) ) {
+            // aborted after it was taken, the failure was reported already
+            if ( fWorker.isStale(completion) ) {
+                continue;
+            }
+
+            if ( !completion.fError.isEmpty() ) {
+                bail(completion.fError);
+                continue;
+            }
+
+            fReplyIndex = completion.fRequest.index;
+            handleResponse(completion.fReply);
+        }
+
+        // removed mid transfer, the worker is done with the handle now
+        if ( !fDevicePresent && fDevice.isInitialized() && !getBusy() ) {
+            fDevice.close();
+        }
+
         emit busyChanged(getBusy());
     }
 
     bool TrezorDevice::getBusy() const
     {
-        return fWorker.isRunning() || !fQueue.empty();
+        return fWorker.isBusy();
     }
 
     void TrezorDevice::cancel()
     {
         Cancel request;
-        fQueue.unlock(); // ensure we don't try and wait for user response
-        sendMessage(request, MessageType_Cancel);
+        fWorker.cancel(serializeMessage(request, MessageType_Cancel, QVariant())); // also stops waiting for user response
+        emit busyChanged(getBusy());
     }
 
     void TrezorDevice::bail(const QString& err)
     {
-        if ( fWorker.isRunning() ) {
-            fWorker.terminate();
-        }
-
-        if ( !fQueue.empty() ) {
-            fQueue.clear();
-        }
+        fWorker.abort();
+        stopSigning();
 
         emit error(err);
     }
 
     const Wire::Message TrezorDevice::serializeMessage(google::protobuf::Message &msg, MessageType type, const QVariant& index)
     {
-        Wire::Message msg_wire;
-        msg_wire.id = type;
-        msg_wire.index = index;
-        msg_wire.data = std::vector<uint8_t>(msg.ByteSizeLong());
-        if ( !msg.SerializeToArray(msg_wire.data.data(), msg.ByteSizeLong()) ) {
-            bail("Could not serialize getAddress msg");
-            return msg_wire;
+        try {
+            return toWire(msg, type, index);
+        } catch ( QString err ) {
+            bail(err);
         }
 
-        return msg_wire;
+        return Wire::Message();
     }
 
     bool TrezorDevice::parseMessage(const Wire::Message &msg_in, google::protobuf::Message& parsed) const
@@ -216,39 +350,7 @@ namespace Trezor {
 
     void TrezorDevice::sendMessage(google::protobuf::Message& msg, MessageType type, const QVariant index)
     {
-        const Wire::Message wireMsg = serializeMessage(msg, type, index);
-
-        if ( type == MessageType_ButtonAck ||
-             type == MessageType_PassphraseAck ||
-             type == MessageType_PassphraseStateAck ||
-             type == MessageType_EthereumTxAck ||
-             type == MessageType_Cancel ) { // these msgs need to always go right after, no matter what we have queued already
-            fQueue.prepend(wireMsg); // no need to check for lock here
-        } else {
-            fQueue.push(wireMsg);
-        }
-
-        sendNext();
-    }
-
-    void TrezorDevice::sendNext()
-    {
-        if ( !fDevice.isInitialized() ) {
-            return;
-        }
-
-        if ( fWorker.isRunning() ) {
-            return;
-        }
-
-        Wire::Message request;
-
-        if ( !fQueue.pop(request)) {
-            return;
-        }
-
-        fWorker.setRequest(request);
-        fWorker.start();
+        fWorker.post(serializeMessage(msg, type, index));
         emit busyChanged(getBusy());
     }
 
@@ -259,7 +361,6 @@ namespace Trezor {
             case MessageType_PinMatrixRequest: handleMatrixRequest(msg_in); return;
             case MessageType_ButtonRequest: handleButtonRequest(msg_in); return;
             case MessageType_PassphraseRequest: handlePassphrase(msg_in); return;
-            case MessageType_PassphraseStateRequest: handlePassphraseStateRequest(msg_in); return;
             case MessageType_Features: handleFeatures(msg_in); return;
             case MessageType_EthereumAddress: handleAddress(msg_in); return;
             case MessageType_EthereumTxRequest: handleTxRequest(msg_in); return;
@@ -282,8 +383,8 @@ namespace Trezor {
         }
 
         const QString error = QString::fromStdString(response.message());
-        emit failure(error);
-        fQueue.clear(); // we cannot continue after failure!
+        stopSigning();
+        emit failure(error); // worker already dropped the rest of the queue
     }
 
     void TrezorDevice::handleMatrixRequest(const Wire::Message &msg_in)
@@ -299,8 +400,7 @@ namespace Trezor {
             return;
         }
 
-        emit matrixRequest(response.type());
-        fQueue.lock(MessageType_PinMatrixAck, fWorker.getIndex()); // we need to wait for this call before making others, saving the index
+        emit matrixRequest(response.type()); // worker holds the queue until the PIN comes in
     }
 
     void TrezorDevice::handleButtonRequest(const Wire::Message &msg_in)
@@ -315,10 +415,7 @@ namespace Trezor {
             bail("error parsing button response");
             return;
         }
-        emit buttonRequest(response.code());
-        // we have to ack right away, worker will wait for actual reply
-        ButtonAck request;
-        sendMessage(request, MessageType_ButtonAck, fWorker.getIndex());
+        emit buttonRequest(response.code()); // already acked by the worker
     }
 
     void TrezorDevice::handlePassphrase(const Wire::Message &msg_in)
@@ -335,24 +432,10 @@ namespace Trezor {
             return;
         }
         
+        // on device entry is acked by the worker, otherwise it holds the queue until submitPassphrase
         emit passphraseRequest(response.on_device());
-        if (response.on_device()) {
-           PassphraseAck request;
-           sendMessage(request, MessageType_PassphraseAck, fWorker.getIndex());
-        } else {
-           fQueue.lock(MessageType_PassphraseAck, fWorker.getIndex()); // we need to wait for this call before making others, saving the index
-        }
     }
     
-    void TrezorDevice::handlePassphraseStateRequest(const Wire::Message &msg_in) {
-       if ( msg_in.id != MessageType_PassphraseStateRequest ) {
-          bail("Unexpected passphrase state response: " + QString::number(msg_in.id));
-       }
-              
-       PassphraseStateAck ack;
-       sendMessage(ack, MessageType_PassphraseStateAck, fWorker.getIndex());
-    }
-
     void TrezorDevice::handleFeatures(const Wire::Message &msg_in)
     {
         if ( msg_in.id != MessageType_Features ) {
@@ -389,7 +472,7 @@ namespace Trezor {
             return;
         }
 
-        if ( fWorker.getIndex().toInt() < 0 ) {
+        if ( fReplyIndex.toInt() < 0 ) {
             bail("Address index lost on reply");
             return;
         }
@@ -401,7 +484,7 @@ namespace Trezor {
         }
 
         const QString addressHex = Etherwall::Helpers::hexPrefix(QByteArray::fromStdString(response.address()));
-        const QString hdPath = fWorker.getIndex().toString();
+        const QString hdPath = fReplyIndex.toString();
         emit addressRetrieved(addressHex, hdPath);
     }
 
@@ -418,55 +501,220 @@ namespace Trezor {
             return;
         }
 
-        if ( response.data_length() > 0 ) {
-            if ( response.data_length() > fPendingTx.dataByteSize() ) {
-                bail("TREZOR requested more bytes than are in the pending tx data");
-                return;
-            }
-
-            EthereumTxAck request;
-            request.set_data_chunk(fPendingTx.dataNext(response.data_length()));
-            sendMessage(request, MessageType_EthereumTxAck, fWorker.getIndex());
-            return;
-        }
-
+        // data requests are fed by the worker, this is the final signature
         quint32 v = response.signature_v();
         std::string r = response.signature_r();
         std::string s = response.signature_s();
 
         fPendingTx.sign(v, r, s);
+        fSigning = false;
         emit transactionReady(fPendingTx);
+        startSigning();
     }
 
     // TrezorWorker
 
-    TrezorWorker::TrezorWorker(Wire::Device &device): QThread(0),
-        fDevice(device)
+    TrezorWorker::TrezorWorker(Wire::Transport &device): QThread(0),
+        fDevice(device), fMutex(), fWake(), fQueue(), fCompleted(), fBusy(false), fStopping(false), fEpoch(0),
+        fTxData(), fTxStreamed(0)
     {
 
     }
 
-    void TrezorWorker::setRequest(const Wire::Message &request)
+    TrezorWorker::~TrezorWorker()
     {
-        fRequest = request;
+        fMutex.lock();
+        fStopping = true;
+        fQueue.clear();
+        fWake.wakeAll();
+        fMutex.unlock();
+
+        fDevice.abort();
+        wait();
     }
 
-    const Wire::Message &TrezorWorker::getReply() const
+    void TrezorWorker::post(const Wire::Message &request)
     {
-        return fReply;
+        QMutexLocker locker(&fMutex);
+        enqueue(request);
+        fWake.wakeAll();
     }
 
-    const QVariant TrezorWorker::getIndex() const
+    void TrezorWorker::post(const QList<Wire::Message>& requests)
     {
-        return fRequest.index;
+        QMutexLocker locker(&fMutex);
+        foreach ( const Wire::Message& request, requests ) {
+            enqueue(request);
+        }
+        fWake.wakeAll();
     }
 
-    // TrezorWorker
+    bool TrezorWorker::takeCompletion(Completion& completion)
+    {
+        QMutexLocker locker(&fMutex);
+        if ( fCompleted.isEmpty() ) {
+            return false;
+        }
+
+        completion = fCompleted.dequeue();
+        return true;
+    }
+
+    bool TrezorWorker::isStale(const Completion& completion) const
+    {
+        QMutexLocker locker(&fMutex);
+        return completion.fEpoch != fEpoch;
+    }
+
+    bool TrezorWorker::isBusy() const
+    {
+        QMutexLocker locker(&fMutex);
+        return fBusy || !fQueue.isEmpty();
+    }
+
+    void TrezorWorker::cancel(const Wire::Message& request)
+    {
+        QMutexLocker locker(&fMutex);
+        fQueue.unlock(); // ensure we don't try and wait for user response
+        fQueue.prepend(request);
+        fWake.wakeAll();
+    }
+
+    void TrezorWorker::abort()
+    {
+        QMutexLocker locker(&fMutex);
+        fEpoch++;
+        fQueue.clear();
+        fQueue.unlock();
+        if ( fBusy ) {
+            fDevice.abort(); // unblocks the pending transfer, the completion carries the error
+        }
+    }
+
+    void TrezorWorker::enqueue(const Wire::Message& request)
+    {
+        // user answers need to go right after, no matter what we have queued already
+        if ( request.id == MessageType_PassphraseAck || request.id == MessageType_Cancel ) {
+            fQueue.prepend(request); // no need to check for lock here
+        } else {
+            fQueue.push(request);
+        }
+    }
+
+    // answers replies that don't need the user, notify tells if the GUI should still hear about it
+    bool TrezorWorker::autoAck(const Wire::Message& reply, const QVariant& index, Wire::Message& ack, bool& notify)
+    {
+        notify = false;
+        switch ( reply.id ) {
+            case MessageType_ButtonRequest: {
+                notify = true; // let the user know to look at the device
+                ack = toWire(ButtonAck(), MessageType_ButtonAck, index);
+                return true;
+            }
+            case MessageType_PassphraseRequest: {
+                PassphraseRequest request;
+                if ( !request.ParseFromArray(reply.data.data(), reply.data.size()) || !request.on_device() ) {
+                    return false; // needs user input
+                }
+
+                notify = true;
+                ack = toWire(PassphraseAck(), MessageType_PassphraseAck, index);
+                return true;
+            }
+            case MessageType_PassphraseStateRequest: {
+                ack = toWire(PassphraseStateAck(), MessageType_PassphraseStateAck, index);
+                return true;
+            }
+            case MessageType_EthereumTxRequest: {
+                EthereumTxRequest request;
+                if ( !request.ParseFromArray(reply.data.data(), reply.data.size()) || request.data_length() == 0 ) {
+                    return false; // final signature, or garbage for the GUI side to report
+                }
+
+                if ( request.data_length() > fTxData.size() - fTxStreamed ) {
+                    throw QString("TREZOR requested more bytes than are in the pending tx data");
+                }
+
+                EthereumTxAck txAck;
+                txAck.set_data_chunk(fTxData.substr(fTxStreamed, request.data_length()));
+                fTxStreamed += request.data_length();
+
+                ack = toWire(txAck, MessageType_EthereumTxAck, index);
+                return true;
+            }
+        }
+
+        return false;
+    }
 
     void TrezorWorker::run()
     {
-        fRequest.write_to(fDevice);
-        fReply.read_from(fDevice);
+        forever {
+            Wire::Message request;
+
+            fMutex.lock();
+            while ( !fStopping && (!fDevice.isInitialized() || !fQueue.pop(request)) ) {
+                fWake.wait(&fMutex);
+            }
+
+            if ( fStopping ) {
+                fMutex.unlock();
+                return;
+            }
+
+            fBusy = true;
+            fDevice.clear_abort();
+            Completion completion;
+            completion.fEpoch = fEpoch;
+            fMutex.unlock();
+
+            completion.fRequest.id = request.id;
+            completion.fRequest.index = request.index;
+            if ( request.id == MessageType_EthereumSignTx ) {
+                // kept past a PIN prompt, the TxRequests then come as replies to the PinMatrixAck
+                fTxData.swap(request.stream_data);
+                fTxStreamed = 0;
+            }
+
+            try {
+                request.write_to(fDevice);
+                completion.fReply.read_from(fDevice);
+
+                Wire::Message ack;
+                bool notify = false;
+                while ( autoAck(completion.fReply, request.index, ack, notify) ) {
+                    if ( notify ) {
+                        fMutex.lock();
+                        fCompleted.enqueue(completion);
+                        fMutex.unlock();
+                        emit completed();
+                    }
+
+                    ack.write_to(fDevice);
+                    completion.fReply.read_from(fDevice);
+                }
+            } catch ( Wire::Device::wire_error& err ) {
+                completion.fError = "TREZOR communication error: " + QString(err.what());
+            } catch ( QString& err ) {
+                completion.fError = err;
+            }
+
+            fMutex.lock();
+            if ( !completion.fError.isEmpty() || completion.fReply.id == MessageType_Failure ) {
+                fQueue.clear(); // we cannot continue after failure!
+                fQueue.unlock();
+            } else if ( completion.fReply.id == MessageType_PinMatrixRequest ) {
+                fQueue.lock(MessageType_PinMatrixAck, request.index); // wait for the PIN before anything else, saving the index
+            } else if ( completion.fReply.id == MessageType_PassphraseRequest ) {
+                fQueue.lock(MessageType_PassphraseAck, request.index); // same for passphrase typed on the host
+            }
+
+            fBusy = false;
+            fCompleted.enqueue(completion);
+            fMutex.unlock();
+
+            emit completed();
+        }
     }
 
     // MessageQueue
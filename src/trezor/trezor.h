@@ -5,8 +5,11 @@
 #include <QString>
 #include <QThread>
 #include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
 #include <QTimer>
 #include <QVariant>
+#include <QScopedPointer>
 #include "proto/messages.pb.h"
 #include "proto/messages-common.pb.h"
 #include "proto/messages-management.pb.h"
@@ -22,22 +25,6 @@ using namespace hw::trezor::messages::ethereum;
 
 namespace Trezor {
 
-    class TrezorWorker: public QThread
-    {
-        Q_OBJECT
-    public:
-        TrezorWorker(Wire::Device& device);
-        void setRequest(const Wire::Message& request);
-        const Wire::Message& getReply() const;
-        const QVariant getIndex() const;
-    protected:
-        virtual void run();
-    private:
-        Wire::Device& fDevice;
-        Wire::Message fRequest;
-        Wire::Message fReply;
-    };
-
     class MessageQueue: public QQueue<Wire::Message>
     {
     public:
@@ -52,6 +39,49 @@ namespace Trezor {
         QVariant fIndex;
     };
 
+    // persistent device actor, owns the message queue and runs the request/reply exchanges on its own thread.
+    // Protocol acks (button, passphrase state, tx data chunks) are answered right here, only replies the user
+    // or the models care about come back to the GUI thread through the completion queue.
+    class TrezorWorker: public QThread
+    {
+        Q_OBJECT
+    public:
+        struct Completion {
+            Wire::Message fRequest;
+            Wire::Message fReply;
+            QString fError;
+            quint64 fEpoch; // abort() count when the request was taken
+        };
+
+        TrezorWorker(Wire::Transport& device);
+        virtual ~TrezorWorker();
+        void post(const Wire::Message& request);
+        void post(const QList<Wire::Message>& requests);
+        bool takeCompletion(Completion& completion);
+        bool isStale(const Completion& completion) const;
+        bool isBusy() const;
+        void cancel(const Wire::Message& request);
+        void abort();
+    signals:
+        void completed() const;
+    protected:
+        virtual void run();
+    private:
+        Wire::Transport& fDevice;
+        mutable QMutex fMutex;
+        QWaitCondition fWake;
+        MessageQueue fQueue;
+        QQueue<Completion> fCompleted;
+        bool fBusy;
+        bool fStopping;
+        quint64 fEpoch; // bumped by abort(), whoever aborts reports the failure of what was in flight
+        std::string fTxData; // worker thread only, stream_data of the last SignTx
+        size_t fTxStreamed;
+
+        void enqueue(const Wire::Message& request);
+        bool autoAck(const Wire::Message& reply, const QVariant& index, Wire::Message& ack, bool& notify);
+    };
+
     class TrezorDevice: public QObject
     {
         Q_OBJECT
@@ -66,14 +96,16 @@ namespace Trezor {
 
         bool isPresent();
         bool isInitialized();
+        bool getBusy() const;
         void getAddress(const HDPath& hdPath);
+        void getAddresses(const QList<HDPath>& hdPaths);
         const QString getDeviceID() const;
         const QString getVersion() const;
         void initialize();
         Q_INVOKABLE void cancel();
         Q_INVOKABLE void submitPin(const QString& pin);
         Q_INVOKABLE void submitPassphrase(const QString& pw);
-        // all values in ether
+        // all values in ether, one signature at a time, the rest wait their turn
         Q_INVOKABLE void signTransaction(quint32 chaindID, const QString& hdPath, const QString& from, const QString& to,
                                          const QString& valStr, quint64 nonce,
                                          const QString& gas = QString(), const QString& gasPrice = QString(),
@@ -92,33 +124,50 @@ namespace Trezor {
         void deviceOutdated(const QString& minVersion, const QString& curVersion) const;
         void error(const QString& error) const;
     public slots:
-        void onDeviceInserted();
-        void onDeviceRemoved();
+        void onDeviceInserted(const QString& path);
+        void onDeviceRemoved(const QString& path);
         void onDirectoryChanged(const QString& path);
         void checkPresence();
     private slots:
         void workerDone();
     private:
-        Wire::Device fDevice;
+        struct SignRequest {
+            quint32 fChainID;
+            QString fHDPath;
+            QString fFrom;
+            QString fTo;
+            QString fValue;
+            quint64 fNonce;
+            QString fGas;
+            QString fGasPrice;
+            QString fData;
+        };
+
+        QScopedPointer<Wire::Transport> fTransport;
+        Wire::Transport& fDevice;
         TrezorWorker fWorker;
-        MessageQueue fQueue;
         QString fDeviceID;
         QString fVersion;
         bool fDevicePresent;
-        Ethereum::Tx fPendingTx;
+        QString fDevicePath; // node the platform reported us on, empty if it can't tell
+        Ethereum::Tx fPendingTx; // GUI thread only, the worker gets its data with the request
+        QQueue<SignRequest> fSignQueue;
+        bool fSigning;
+        QVariant fReplyIndex; // index of the request the reply being handled belongs to
 
-        bool getBusy() const;
+        void setPresent(bool present);
         void bail(const QString& err);
+        void startSigning();
+        void stopSigning();
         const Wire::Message serializeMessage(google::protobuf::Message& msg, MessageType, const QVariant& index);
+        bool buildGetAddress(const HDPath& hdPath, EthereumGetAddress& request);
         bool parseMessage(const Wire::Message& msg_in, google::protobuf::Message& parsed) const;
         void sendMessage(google::protobuf::Message& msg, MessageType type, QVariant index = QVariant());
-        void sendNext();
         void handleResponse(const Wire::Message& msg_in);
         void handleFailure(const Wire::Message& msg_in);
         void handleMatrixRequest(const Wire::Message& msg_in);
         void handleButtonRequest(const Wire::Message& msg_in);
         void handlePassphrase(const Wire::Message& msg_in);
-        void handlePassphraseStateRequest(const Wire::Message& msg_in);
         void handleFeatures(const Wire::Message& msg_in);
         void handleAddress(const Wire::Message& msg_in);
         void handleTxRequest(const Wire::Message& msg_in);
@@ -23,35 +23,43 @@
 #include <netinet/in.h>
 #endif
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "wire.h"
 
 #define DEBUG_TRANSFER     0
 
-#define TREZOR1_VID        0x534c
-#define TREZOR1_PID        0x0001
-#define TREZOR2_VID        0x1209
-#define TREZOR2_PID        0x53c1
-
 namespace Trezor {
 
 namespace Wire {
 
     Device::Device()
     {
+        read_pos = 0;
+        read_len = 0;
         hid_version = 0;
         hid_init();
 
         hid = nullptr;
         usb_dev = nullptr;
+        usb_fd = -1;
+        path_from_platform = false;
         
         usb = nullptr;
         (void)libusb_init(&usb);
+        usb_xfer = libusb_alloc_transfer(0);
+        usb_xfer_pending = false;
+        aborted = false;
         
         trezor_ver = Trezor_V1;
     }
 
     Device::~Device() {
         close();
+        libusb_free_transfer(usb_xfer);
         
         if (usb) {
            libusb_exit(usb);
@@ -64,9 +72,9 @@ namespace Wire {
     void Device::init()
     {
         close();
+        aborted = false;
 
-        libusb_device_handle* t2 =
-           libusb_open_device_with_vid_pid (usb, TREZOR2_VID, TREZOR2_PID);
+        libusb_device_handle* t2 = open_usb();
        
         if (nullptr != t2) {
            if (0 == libusb_claim_interface(t2, 0)) {
@@ -78,22 +86,39 @@ namespace Wire {
               if (usb_max_size <= 0) {
                  throw wire_error("failed to get usb packet size.");
               }
+
+              if (static_cast<size_t>(usb_max_size) > read_buffer.size()) {
+                 throw wire_error("usb packet size too big.");
+              }
+
+              usb_report.resize(usb_max_size);
                         
               usb_dev = t2;
               trezor_ver = Trezor_V2;
               hid_version = 1;
               return;
            }
+
+           libusb_close(t2);
+           close_usb_fd();
         }
 
         hid = nullptr;
-        const QString path = getDevicePath();
-        if ( path.isEmpty() ) {
+        if ( is_usb_path() ) {
+            return; // model T we were pointed at is gone
+        }
+
+        if ( device_path.isEmpty() ) {
+            device_path = getDevicePath(); // only enumerate if nobody told us where it is
+        }
+
+        if ( device_path.isEmpty() ) {
             return;
         }
 
-        hid = hid_open_path(path.toStdString().c_str());
+        hid = hid_open_path(device_path.toStdString().c_str());
         if (!hid) {
+            forget_probed_path();
 #ifdef Q_OS_LINUX
             throw wire_error("HID device open failed, <a href=\"https://doc.satoshilabs.com/trezor-user/settingupchromeonlinux.html\">check your udev permissions</a>");
 #else
@@ -111,6 +136,57 @@ namespace Wire {
         return hid_version > 0 || Trezor_V2 == trezor_ver;
     }
 
+    void Device::setDevicePath(const QString& path)
+    {
+        device_path = path;
+        path_from_platform = !path.isEmpty();
+    }
+
+    bool Device::is_usb_path() const
+    {
+        return device_path.startsWith("/dev/bus/usb/");
+    }
+
+    // with a path we open exactly that device, so several TREZORs can each have their own Device
+    libusb_device_handle* Device::open_usb()
+    {
+        if ( device_path.isEmpty() ) {
+            return libusb_open_device_with_vid_pid(usb, TREZOR2_VID, TREZOR2_PID);
+        }
+
+        if ( !is_usb_path() ) {
+            return nullptr; // hidraw node, a TREZOR One
+        }
+
+#ifdef __linux__
+        // "/dev/bus/usb/BBB/DDD" as udev reports it, wrap the node directly instead of walking the bus
+        usb_fd = ::open(device_path.toUtf8().constData(), O_RDWR);
+        if (usb_fd < 0) {
+            return nullptr;
+        }
+
+        libusb_device_handle* handle = nullptr;
+        if (0 != libusb_wrap_sys_device(usb, static_cast<intptr_t>(usb_fd), &handle)) {
+            close_usb_fd();
+            return nullptr;
+        }
+
+        return handle;
+#else
+        return nullptr; // only udev hands out usb node paths
+#endif
+    }
+
+    void Device::close_usb_fd()
+    {
+#ifdef __linux__
+        if (usb_fd >= 0) {
+            ::close(usb_fd);
+        }
+#endif
+        usb_fd = -1;
+    }
+
     const QString Device::getDevicePath()
     {  
         QString path;
@@ -136,6 +212,11 @@ namespace Wire {
 
     void Device::close()
     {
+        read_pos = 0;
+        read_len = 0;
+        hid_version = 0;
+        trezor_ver = Trezor_V1;
+
         if ( hid != nullptr ) {
             hid_close(hid);
         }
@@ -146,39 +227,94 @@ namespace Wire {
            libusb_close(usb_dev);
            usb_dev = NULL;
         }
+        close_usb_fd(); // libusb_close leaves a wrapped fd to us
     }
 
+    // presence comes from hotplug events and the cached node, the bus is only walked when there's
+    // nothing to go on: the startup probe and pathless arrivals on platforms without udev
     bool Device::isPresent()
     {
-       libusb_device** usb_devices = nullptr;
-       size_t nDev = libusb_get_device_list(usb, &usb_devices);
-       
-       if (nullptr != usb_devices && nDev > 0) {
-          for (size_t i=0; i<nDev; i++) {
-             libusb_device* dev = usb_devices[i];
-             libusb_device_descriptor desc;
-             
-             if (0 == libusb_get_device_descriptor(dev, &desc)) {
-                if (TREZOR2_VID == desc.idVendor && TREZOR2_PID == desc.idProduct) {
-                   return 1;
-                }
-             }
-          }
-          
-          libusb_free_device_list(usb_devices, 1);
-       }
-       
+        if ( usb_dev != nullptr ) {
+            int config = 0; // a control request, fails with NO_DEVICE once it's unplugged
+            if ( libusb_get_configuration(usb_dev, &config) == LIBUSB_ERROR_NO_DEVICE ) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
         // if we're connected, use try_hid_version to check if connection still works
         if ( hid != nullptr ) {
             bool connected = try_hid_version() > 0;
             if ( !connected ) {
                 close(); // make sure hid frees resources and we consider ourselves off
+                forget_probed_path();
             }
             return connected;
         }
 
-        // otherwise enumerate
-        return getDevicePath() != nullptr;
+        if ( !device_path.isEmpty() ) {
+            if ( node_opens() ) {
+                return true;
+            }
+
+            forget_probed_path();
+            return false;
+        }
+
+        return probe();
+    }
+
+    bool Device::node_opens() const
+    {
+        if ( is_usb_path() ) {
+#ifdef __linux__
+            return ::access(device_path.toUtf8().constData(), R_OK | W_OK) == 0;
+#else
+            return false;
+#endif
+        }
+
+        hid_device* node = hid_open_path(device_path.toStdString().c_str());
+        if ( node == nullptr ) {
+            return false;
+        }
+
+        hid_close(node);
+        return true;
+    }
+
+    void Device::forget_probed_path()
+    {
+        // the platform's path stays until it tells us it's gone, one we found ourselves is looked up again
+        if ( !path_from_platform ) {
+            device_path = QString();
+        }
+    }
+
+    bool Device::probe()
+    {
+        libusb_device** usb_devices = nullptr;
+        ssize_t nDev = libusb_get_device_list(usb, &usb_devices);
+        bool found = false;
+
+        for ( ssize_t i = 0; i < nDev && !found; i++ ) {
+            libusb_device_descriptor desc;
+            if ( 0 == libusb_get_device_descriptor(usb_devices[i], &desc) ) {
+                found = TREZOR2_VID == desc.idVendor && TREZOR2_PID == desc.idProduct;
+            }
+        }
+
+        if ( nullptr != usb_devices ) {
+            libusb_free_device_list(usb_devices, 1);
+        }
+
+        if ( found ) {
+            return true; // model T, opened by vid/pid in init
+        }
+
+        device_path = getDevicePath();
+        return !device_path.isEmpty();
     }
 
     // try writing packet that will be discarded to figure out hid version
@@ -218,51 +354,69 @@ namespace Wire {
             throw wire_error("Read called with null handle");
         }
 
-        for (;;) {
-            if (read_buffer.empty()) {
-                buffer_report();
-            }
-            size_t n = read_report_from_buffer(data, len);
-            if (n < len) {
+        while (len > 0) {
+            if (read_len > 0) {
+                size_t n = read_report_from_buffer(data, len);
                 data += n;
                 len -= n;
-            } else {
-                break;
+                continue;
             }
+
+            // nothing buffered, copy the report straight to the destination and keep the rest
+            char_type const *payload = nullptr;
+            size_t size = read_report(payload);
+            size_t n = std::min(size, len);
+            std::copy(payload, payload + n, data);
+            buffer_payload(payload + n, size - n);
+            data += n;
+            len -= n;
         }
     }
 
     void Device::write(char_type const *data, size_t len)
+    {
+        write(nullptr, 0, data, len);
+    }
+
+    void Device::write(char_type const *head, size_t head_len, char_type const *data, size_t len)
     {
         if (!hid && !usb_dev) {
             throw wire_error("Write called with null handle");
         }
 
-        for (;;) {
-            size_t n = write_report(data, len);
-            if (n < len) {
-                data += n;
-                len -= n;
-            } else {
-                break;
-            }
-        }
+        // both parts are streamed straight into the report frames, never joined in between
+        do {
+            write_report(head, head_len, data, len);
+        } while (head_len + len > 0);
     }
 
     size_t Device::read_report_from_buffer(char_type *data, size_t len)
     {
         using namespace std;
 
-        size_t n = min(read_buffer.size(), len);
-        auto r1 = read_buffer.begin();
-        auto r2 = read_buffer.begin() + n;
+        size_t n = min(read_len, len);
+        size_t first = min(n, read_buffer.size() - read_pos); // up to the wrap point
 
-        copy(r1, r2, data); // copy to data
-        read_buffer.erase(r1, r2); // shift from buffers
+        copy(read_buffer.begin() + read_pos, read_buffer.begin() + read_pos + first, data);
+        copy(read_buffer.begin(), read_buffer.begin() + (n - first), data + first);
+        read_pos = (read_pos + n) % read_buffer.size();
+        read_len -= n;
 
         return n;
     }
 
+    void Device::buffer_payload(char_type const *payload, size_t len)
+    {
+        if (read_len + len > read_buffer.size()) {
+            throw wire_error("Read buffer overflow");
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            read_buffer[(read_pos + read_len + i) % read_buffer.size()] = payload[i];
+        }
+        read_len += len;
+    }
+
 #if DEBUG_TRANSFER
     static void dump_hex(const void* data, size_t size) {
     	char ascii[17];
@@ -295,7 +449,8 @@ namespace Wire {
     }
 #endif
 
-    void Device::buffer_report()
+    // blocks until a report arrives, payload points into our report buffers until the next read
+    size_t Device::read_report(char_type const *&payload)
     {
         if (!hid && !usb_dev) {
             throw wire_error("Buffer report called with null handle");
@@ -304,21 +459,19 @@ namespace Wire {
         using namespace std;
         
         int r;
+        size_t n = 0;
 
         if (usb_dev) {
-           std::vector<char_type> data;
-           
-           data.resize(usb_max_size);
-           
            do {
               int recvd = 0;
               
-              r = libusb_bulk_transfer(usb_dev, 0x81, data.data(), data.size(), &recvd, 50);
+              // no timeout, the event loop wakes us up once the report is in
+              r = usb_transfer(0x81, usb_report.data(), usb_report.size(), recvd);
                             
               if (0 == r) {
                  r = recvd;
-              } else if (LIBUSB_ERROR_TIMEOUT == r) {
-                 r = 0;
+              } else if (LIBUSB_ERROR_INTERRUPTED == r) {
+                 throw wire_error("USB device read aborted");
               } else {
                  r = -1;
               }
@@ -328,71 +481,143 @@ namespace Wire {
                throw wire_error("USB device read failed");
            }
            
-           if (r > 0) {
-               copy(data.begin() + 1 ,
-                    data.begin() + data.size(),
-                    back_inserter(read_buffer));
-           }
+           // skip the report number
+           payload = usb_report.data() + 1;
+           n = usb_report.size() - 1;
 #if DEBUG_TRANSFER
-           printf("READ %u -----\n", data.size());
-           dump_hex(data.data(), data.size());
+           printf("READ %u -----\n", usb_report.size());
+           dump_hex(usb_report.data(), usb_report.size());
            printf("----------\n");
 #endif
         } else {
-           report_type report;
-           
            do {
-              r = hid_read_timeout(hid, report.data(), report.size(), 50);
+              if (aborted) {
+                  throw wire_error("HID device read aborted");
+              }
+              r = hid_read_timeout(hid, hid_report.data(), hid_report.size(), 50);
            } while (r == 0);
 
            if (r < 0) {
                throw wire_error("HID device read failed");
            }
         
-           if (r > 0) {
-               // copy to the buffer, skip the report number
-               char_type rn = report[0];
-               size_t n = min(static_cast<size_t>(rn),
-                                 static_cast<size_t>(r - 1));
-               copy(report.begin() + 1,
-                    report.begin() + 1 + n,
-                    back_inserter(read_buffer));
-           }
+           // skip the report number
+           char_type rn = hid_report[0];
+           payload = hid_report.data() + 1;
+           n = min(static_cast<size_t>(rn),
+                   static_cast<size_t>(r - 1));
            
 #if DEBUG_TRANSFER
-           printf("READ %u -----\n", report.size());
-           dump_hex(report.data(), report.size());
+           printf("READ %u -----\n", hid_report.size());
+           dump_hex(hid_report.data(), hid_report.size());
            printf("----------\n");
 #endif
         }
+
+        return n;
+    }
+
+    static void LIBUSB_CALL transfer_done(libusb_transfer* transfer)
+    {
+        int* completed = static_cast<int*>(transfer->user_data);
+        *completed = 1;
+    }
+
+    // async bulk transfer, blocks in the libusb event loop until it completes or gets cancelled
+    int Device::usb_transfer(unsigned char endpoint, char_type *data, int len, int &transferred)
+    {
+        int completed = 0;
+        libusb_fill_bulk_transfer(usb_xfer, usb_dev, endpoint, data, len, transfer_done, &completed, 0);
+
+        int r;
+        {
+            // an abort either happened before and we don't submit, or comes after and sees it pending
+            std::lock_guard<std::mutex> lock(usb_xfer_lock);
+            if (aborted) {
+                return LIBUSB_ERROR_INTERRUPTED;
+            }
+
+            r = libusb_submit_transfer(usb_xfer);
+            if (r != 0) {
+                return r;
+            }
+            usb_xfer_pending = true;
+        }
+
+        while (!completed) {
+            r = libusb_handle_events_completed(usb, &completed);
+            if (r < 0 && r != LIBUSB_ERROR_INTERRUPTED) {
+                libusb_cancel_transfer(usb_xfer); // completion still arrives, with cancelled status
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(usb_xfer_lock);
+            usb_xfer_pending = false;
+        }
+
+        transferred = usb_xfer->actual_length;
+        switch (usb_xfer->status) {
+            case LIBUSB_TRANSFER_COMPLETED: return 0;
+            case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+            case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+            case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+            default: return LIBUSB_ERROR_IO;
+        }
+    }
+
+    void Device::abort()
+    {
+        std::lock_guard<std::mutex> lock(usb_xfer_lock);
+        aborted = true;
+        if (usb_xfer_pending) {
+            libusb_cancel_transfer(usb_xfer);
+        }
+    }
+
+    void Device::clear_abort()
+    {
+        aborted = false;
     }
 
-    size_t Device::write_report(char_type const *data, size_t len)
+    // fills one report with up to 63 bytes taken from head first and then data, advancing both
+    void Device::write_report(char_type const *&head, size_t &head_len, char_type const *&data, size_t &len)
     {
         using namespace std;
 
         report_type report;
         report.fill(0x00);
 
-        size_t n = min(static_cast<size_t>(63), len);
         size_t report_size = 63 + hid_version;
+        size_t offset = 0;
 
         switch (hid_version) {
             case 1:
                 report[0] = 0x3F;
-                copy(data, data + n, report.begin() + 1);
+                offset = 1;
                 break;
             case 2:
                 report[0] = 0x00;
                 report[1] = 0x3F;
-                copy(data, data + n, report.begin() + 2);
+                offset = 2;
                 break;
         }
 
+        size_t n = min(static_cast<size_t>(63), head_len);
+        copy(head, head + n, report.begin() + offset);
+        head += n;
+        head_len -= n;
+        offset += n;
+
+        n = min(static_cast<size_t>(63) - n, len);
+        copy(data, data + n, report.begin() + offset);
+        data += n;
+        len -= n;
+
         int r = 0, xferd = 0;
 
         if (usb_dev) {
-           r = libusb_bulk_transfer(usb_dev, 0x1, report.data(), report.size()-1, &xferd, 0);
+           r = usb_transfer(0x1, report.data(), report.size()-1, xferd);
         } else {
            r = 0;
            xferd = hid_write(hid, report.data(), report_size);
@@ -410,13 +635,11 @@ namespace Wire {
         dump_hex(report.data(), report.size());
         printf("----------\n");
 #endif
-
-        return n;
     }
 
-    void Message::read_from(Device &device)
+    void Message::read_from(Transport &device)
     {
-        Device::char_type buf[6];
+        Transport::char_type buf[6];
         std::uint32_t size;
 
         device.read_buffered(buf, 1);
@@ -445,10 +668,9 @@ namespace Wire {
         device.read_buffered(data.data(), data.size());
     }
 
-    void Message::write_to(Device &device) const
+    void Message::write_to(Transport &device) const
     {
-        std::size_t buf_size = 8 + data.size();
-        Device::char_type buf[buf_size];
+        Transport::char_type buf[8];
 
         buf[0] = '#';
         buf[1] = '#';
@@ -463,12 +685,9 @@ namespace Wire {
         buf[6] = (size_ >> 16) & 0xFF;
         buf[7] = (size_ >> 24) & 0xFF;
 
-        std::copy(data.begin(), data.end(), &buf[8]);
-        device.write(buf, buf_size);
+        device.write(buf, sizeof(buf), data.data(), data.size());
     }
 
 }
 
 }
-
-
@@ -31,14 +31,23 @@
 #include <QDebug>
 #include <QVariant>
 #include <QString>
+#include <QStringList>
 #include <vector>
 #include <array>
+#include <atomic>
+#include <mutex>
+
+#define TREZOR1_VID        0x534c
+#define TREZOR1_PID        0x0001
+#define TREZOR2_VID        0x1209
+#define TREZOR2_PID        0x53c1
 
 namespace Trezor {
 
 namespace Wire {
 
-    class Device
+    // byte stream to a device, real hardware or the emulator
+    class Transport
     {
     public:
         typedef std::uint8_t char_type;
@@ -47,37 +56,83 @@ namespace Wire {
             : public std::runtime_error
         { using std::runtime_error::runtime_error; };
 
+        virtual ~Transport() {}
+
+        virtual void init() = 0;
+        virtual bool isInitialized() const = 0;
+        virtual void close() = 0;
+        // cheap check of the open or cached device, only looks around when there's nothing cached
+        virtual bool isPresent() = 0;
+        // node reported by the platform's hotplug events, empty to look it up when opening
+        virtual void setDevicePath(const QString& path) = 0;
+
+        virtual void read_buffered(char_type *data, size_t len) = 0;
+        virtual void write(char_type const *data, size_t len) = 0;
+        // writes head followed by data as one contiguous stream
+        virtual void write(char_type const *head, size_t head_len, char_type const *data, size_t len) = 0;
+        // interrupt a blocked read/write from another thread, the call throws wire_error
+        virtual void abort() = 0;
+        virtual void clear_abort() = 0;
+    };
+
+    class Device: public Transport
+    {
+    public:
         Device();
         Device(Device const&) = delete;
         Device &operator=(Device const&) = delete;
-        ~Device();
+        virtual ~Device();
 
-        void init();
-        bool isInitialized() const;
-        void close();
+        virtual void init();
+        virtual bool isInitialized() const;
+        virtual void close();
 
-        bool isPresent();
+        virtual bool isPresent();
+        virtual void setDevicePath(const QString& path);
         // try writing packet that will be discarded to figure out hid version
         int try_hid_version();
-        void read_buffered(char_type *data, size_t len);
+        virtual void read_buffered(char_type *data, size_t len);
 
-        void write(char_type const *data, size_t len);
+        virtual void write(char_type const *data, size_t len);
+        virtual void write(char_type const *head, size_t head_len, char_type const *data, size_t len);
+        virtual void abort();
+        virtual void clear_abort();
         static const QString getDevicePath();
     private:
+        bool is_usb_path() const;
+        bool node_opens() const;
+        void forget_probed_path();
+        bool probe();
+        libusb_device_handle* open_usb();
+        void close_usb_fd();
         size_t read_report_from_buffer(char_type *data, size_t len);
-        void buffer_report();
-        size_t write_report(char_type const *data, size_t len);
+        size_t read_report(char_type const *&payload);
+        void buffer_payload(char_type const *payload, size_t len);
+        void write_report(char_type const *&head, size_t &head_len, char_type const *&data, size_t &len);
+        int usb_transfer(unsigned char endpoint, char_type *data, int len, int &transferred);
 
-        typedef std::vector<char_type> buffer_type;
+        // fixed ring for report bytes not yet consumed, nothing is allocated while reading
+        typedef std::array<char_type, 1024> buffer_type;
         typedef std::array<char_type, 65> report_type;
 
         hid_device *hid;
         buffer_type read_buffer;
+        size_t read_pos;
+        size_t read_len;
+        report_type hid_report;
         int hid_version;
+        QString device_path; // cached between opens so init doesn't walk the bus again
+        bool path_from_platform; // device_path came from a hotplug event, not our own probe
         
         libusb_context* usb;
         libusb_device_handle* usb_dev;
+        int usb_fd; // node wrapped by open_usb, -1 when libusb opened the device itself
         int usb_max_size;
+        std::vector<char_type> usb_report; // sized once per init to the endpoint packet size
+        libusb_transfer* usb_xfer; // reused for every async bulk transfer
+        std::mutex usb_xfer_lock; // submit and abort's cancel can't interleave, or the abort gets lost
+        bool usb_xfer_pending; // guarded by usb_xfer_lock
+        std::atomic<bool> aborted;
         
         enum {
            Trezor_V1, Trezor_V2
@@ -90,11 +145,12 @@ namespace Wire {
         std::uint16_t id;
         std::vector<std::uint8_t> data;
         QVariant index; // for keeping track on queue side
+        std::string stream_data; // tx data past the initial chunk, the worker sends it in TxAck chunks
 
-        typedef Device::wire_error header_wire_error;
+        typedef Transport::wire_error header_wire_error;
 
-        void read_from(Device &device);
-        void write_to(Device &device) const;
+        void read_from(Transport &device);
+        void write_to(Transport &device) const;
     };
 
 }